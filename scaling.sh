@@ -0,0 +1,130 @@
+#!/bin/bash
+#==========================================================================================================
+# scaling.sh - Runs esp over synthetic workloads across a grid of frame sizes, record counts and thread
+#              counts, and records the throughput of every stage in a CSV file.  Plotting a stage's
+#              throughput against the record count or the thread count gives its scaling curve
+#
+# Usage: scaling.sh <esp> <results.csv> [<baseline.csv>]
+#
+# For each point on the grid, two things are measured:
+#
+#   - "esp -bench", which times parsing, frame building, LVDS re-ordering, frame generation and
+#     each output back-end separately
+#
+#   - an end-to-end run that creates an output file from a workload written by "esp -synth", whose
+#     sequences fill the whole contig_size
+#
+# If <baseline.csv> (the results of an earlier run) is given, every stage whose throughput has
+# fallen by more than SCALING_TOLERANCE percent is reported, and the exit status is 1 if there
+# are any
+#
+# The grid and the workload are set by these environment variables:
+#
+#   SCALING_CELLS     : the cells_per_frame values (multiples of 64)  default "2048 32768"
+#   SCALING_RECORDS   : the numbers of distribution records          default "10000 100000"
+#   SCALING_THREADS   : the thread counts                            default "1 4"
+#   SCALING_CONTIG    : contig_size of the end-to-end runs, in bytes default 1073741824
+#   SCALING_TOLERANCE : the slow-down (in percent) that's reported   default 10
+#   SCALING_DIR       : where the workloads and output files go      default a temporary directory
+#==========================================================================================================
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <esp> <results.csv> [<baseline.csv>]" >&2
+    exit 2
+fi
+
+ESP=$(realpath "$1")
+RESULTS=$2
+BASELINE=$3
+
+CELLS=${SCALING_CELLS:-"2048 32768"}
+RECORDS=${SCALING_RECORDS:-"10000 100000"}
+THREADS=${SCALING_THREADS:-"1 4"}
+CONTIG=${SCALING_CONTIG:-1073741824}
+TOLERANCE=${SCALING_TOLERANCE:-10}
+
+# The work directory is only removed if we created it
+if [ -n "$SCALING_DIR" ]; then
+    WORK=$SCALING_DIR
+    mkdir -p "$WORK" || exit 1
+else
+    WORK=$(mktemp -d) || exit 1
+    trap 'rm -rf "$WORK"' EXIT
+fi
+
+#----------------------------------------------------------------------------------------------------------
+# writeConfig <cells> - Writes the configuration file for a workload with <cells> cells per frame
+#----------------------------------------------------------------------------------------------------------
+writeConfig()
+{
+    cat > "$WORK/scaling.conf" <<EOF
+cells_per_frame   = $1
+contig_size       = $CONTIG
+data_frames       = 13
+diagnostic_values = 34, 32, 172
+quiescent         = 170
+fragment_file     = "$WORK/fragments.csv"
+distribution_file = "$WORK/distribution.csv"
+output_file       = "$WORK/output.dat"
+EOF
+}
+#----------------------------------------------------------------------------------------------------------
+
+
+echo "cells,records,threads,stage,frames,seconds,frames_per_sec,gb_per_sec" > "$RESULTS"
+
+for cells in $CELLS; do
+    writeConfig $cells
+
+    for records in $RECORDS; do
+
+        # Write the workload for the end-to-end runs
+        "$ESP" -config "$WORK/scaling.conf" -synth $records > /dev/null || exit 1
+
+        for threads in $THREADS; do
+            echo "$cells cells per frame, $records records, $threads thread(s)"
+
+            # Time each stage by itself.  The last five columns of each row of the table are
+            # numbers, and everything before them is the name of the stage
+            "$ESP" -config "$WORK/scaling.conf" -bench $records -threads $threads \
+            | awk -v prefix="$cells,$records,$threads" '
+                /^Stage/ {table = 1; next}
+                table && NF >= 6 {
+                    name = $1
+                    for (i = 2; i <= NF - 5; ++i) name = name " " $i
+                    printf "%s,%s,%s,%s,%s,%s\n", prefix, name, $(NF-4), $(NF-3), $(NF-2), $(NF-1)
+                }' >> "$RESULTS" || exit 1
+
+            # Time creating the whole output file, from parsing the input files to the last byte
+            start=$(date +%s%N)
+            "$ESP" -config "$WORK/scaling.conf" -threads $threads > "$WORK/run.log" || exit 1
+            end=$(date +%s%N)
+            frames=$(grep "Frames required in total" "$WORK/run.log" | tr -dc '0-9')
+            awk -v prefix="$cells,$records,$threads" -v frames=$frames -v cells=$cells \
+                -v ns=$((end - start)) 'BEGIN {
+                    s = ns / 1e9
+                    printf "%s,end-to-end,%d,%.3f,%.0f,%.3f\n", prefix, frames, s, frames / s, frames * cells / s / 1e9
+                }' >> "$RESULTS"
+            rm -f "$WORK/output.dat"*
+        done
+    done
+done
+
+echo "Results are in $RESULTS"
+
+# Compare the results to the baseline, if there is one
+if [ -n "$BASELINE" ]; then
+    awk -F, -v tolerance=$TOLERANCE '
+        FNR == 1 {next}
+        NR == FNR {base[$1 "," $2 "," $3 "," $4] = $8; next}
+        {
+            key = $1 "," $2 "," $3 "," $4
+            if ((key in base) && base[key] > 0 && $8 < base[key] * (1 - tolerance / 100)) {
+                printf "Slower: %s (%.3f GB/s, was %.3f)\n", key, $8, base[key]
+                slower = 1
+            }
+        }
+        END {exit slower}' "$BASELINE" "$RESULTS"
+    if [ $? -ne 0 ]; then exit 1; fi
+    echo "No stage is more than $TOLERANCE% slower than in $BASELINE"
+fi
@@ -0,0 +1,437 @@
+//==========================================================================================================
+// chunked_file.cpp - Implements the writer and reader of the "chunked" output format
+//==========================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <algorithm>
+#include <zlib.h>
+#include "chunked_file.h"
+#include "errors.h"
+
+using namespace std;
+
+const char CChunkedWriter::MAGIC[8]       = {'E', 'S', 'P', 'C', 'H', 'K', '0', '1'};
+const char CChunkedWriter::INDEX_MAGIC[8] = {'E', 'S', 'P', 'C', 'I', 'D', 'X', '1'};
+
+
+//==========================================================================================================
+// CChunkedWriter() - Constructor.  Starts the compressor threads
+//==========================================================================================================
+CChunkedWriter::CChunkedWriter(CFrameWriter* inner, uint32_t frameSize, uint32_t chunkFrames, uint32_t threads,
+                               int level) : m_inner(inner)
+{
+    m_frameSize   = frameSize;
+    m_chunkFrames = chunkFrames;
+    m_chunkBytes  = (uint64_t)frameSize * chunkFrames;
+    m_level       = level;
+    m_submitted   = 0;
+    m_written     = 0;
+    m_offset      = 0;
+    m_quit        = false;
+
+    // The length of a stored chunk has to fit into its index entry
+    if (m_chunkBytes == 0 || m_chunkBytes > UINT32_MAX) throw runtime_error("Invalid chunk size for chunked output");
+
+    // Each compressor thread gets two slots, so it never has to wait for the writer very long, plus
+    // there's one more for the chunk that's being filled
+    if (threads == 0) threads = 1;
+    m_slot.resize(2 * threads + 1);
+    for (auto& s : m_slot)
+    {
+        s.raw.resize(m_chunkBytes);
+        s.rawLength  = 0;
+        s.compressed = false;
+    }
+
+    for (uint32_t i=0; i<threads; ++i) m_threads.push_back(thread(&CChunkedWriter::compressorThread, this));
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// ~CChunkedWriter() - Destructor.  Makes sure the compressor threads have stopped
+//==========================================================================================================
+CChunkedWriter::~CChunkedWriter()
+{
+    stopThreads();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Creates the output file and writes the file header
+//==========================================================================================================
+void CChunkedWriter::open(string filename, uint64_t totalBytes)
+{
+    chunkHeader_t header;
+    memcpy(header.magic, MAGIC, sizeof header.magic);
+    header.frameSize   = m_frameSize;
+    header.chunkFrames = m_chunkFrames;
+    header.totalFrames = totalBytes / m_frameSize;
+
+    m_inner->open(filename, totalBytes);
+    m_inner->write((const uint8_t*)&header, sizeof header);
+    m_offset = sizeof header;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// write() - Gathers the incoming data into chunks, and hands each full chunk to the compressor threads
+//==========================================================================================================
+void CChunkedWriter::write(const uint8_t* data, size_t length)
+{
+    while (length)
+    {
+        // Copy as much as will fit into the chunk being filled
+        slot_t& s = m_slot[m_submitted % m_slot.size()];
+        size_t n = min<uint64_t>(length, m_chunkBytes - s.rawLength);
+        memcpy(s.raw.data() + s.rawLength, data, n);
+        s.rawLength += n;
+        data        += n;
+        length      -= n;
+
+        // If the chunk is full, send it on its way
+        if (s.rawLength == m_chunkBytes) submitChunk();
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close() - Compresses and writes the final chunk, writes the index and the trailer, and closes the
+//           output file
+//==========================================================================================================
+void CChunkedWriter::close()
+{
+    // Send the final (partial) chunk on its way, and write every chunk that's still outstanding
+    slot_t& s = m_slot[m_submitted % m_slot.size()];
+    if (s.rawLength % m_frameSize) throw runtime_error("Output data doesn't end on a frame boundary");
+    if (s.rawLength) submitChunk();
+    writeChunks(true);
+    stopThreads();
+
+    // Write the index and the trailer
+    chunkTrailer_t trailer;
+    trailer.indexOffset = m_offset;
+    memcpy(trailer.magic, INDEX_MAGIC, sizeof trailer.magic);
+    m_inner->write((const uint8_t*)m_index.data(), m_index.size() * sizeof(chunkIndex_t));
+    m_inner->write((const uint8_t*)&trailer, sizeof trailer);
+
+    m_inner->close();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// submitChunk() - Queues the chunk that has just been filled for compression, then writes whatever
+//                 compressed chunks are ready (waiting, if need be, for a slot to come free)
+//==========================================================================================================
+void CChunkedWriter::submitChunk()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_queue.push_back(m_submitted % m_slot.size());
+    }
+    m_cvWork.notify_one();
+    ++m_submitted;
+
+    writeChunks(false);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// writeChunks() - Writes compressed chunks to the inner back-end in order
+//
+// If 'all' is false, this only waits for a chunk when every slot is in use (so that the next chunk
+// has somewhere to go).  Otherwise, it waits until every submitted chunk has been written
+//==========================================================================================================
+void CChunkedWriter::writeChunks(bool all)
+{
+    while (m_written < m_submitted)
+    {
+        slot_t& s = m_slot[m_written % m_slot.size()];
+
+        // Wait for the oldest chunk to be compressed, unless we don't have to
+        {
+            unique_lock<mutex> lock(m_mutex);
+            if (!s.compressed)
+            {
+                if (!all && m_submitted - m_written < m_slot.size()) return;
+                m_cvDone.wait(lock, [&]{return s.compressed;});
+            }
+        }
+
+        // Write it, and record where it is in the file
+        m_inner->write(s.packed.data(), s.packed.size());
+        m_index.push_back({m_offset, (uint32_t)s.packed.size(), s.method});
+        m_offset += s.packed.size();
+
+        // The slot is free to hold another chunk
+        s.compressed = false;
+        s.rawLength  = 0;
+        ++m_written;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// compressorThread() - Compresses chunks as they're queued, until told to quit
+//==========================================================================================================
+void CChunkedWriter::compressorThread()
+{
+    while (true)
+    {
+        size_t index;
+
+        // Wait for a chunk to compress
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_cvWork.wait(lock, [&]{return m_quit || !m_queue.empty();});
+            if (m_queue.empty()) return;
+            index = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        compress(m_slot[index]);
+
+        // Tell the writer that the chunk is ready
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_slot[index].compressed = true;
+        }
+        m_cvDone.notify_all();
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// compress() - Produces the stored form of a chunk.   A chunk in which every byte is the same (which is
+//              what diagnostic frames and quiescent filler are made of) is stored as just that byte.
+//              Anything that deflate can't make smaller is stored as-is
+//==========================================================================================================
+void CChunkedWriter::compress(slot_t& s)
+{
+    const uint8_t* raw = s.raw.data();
+    size_t length = s.rawLength;
+
+    if (memcmp(raw, raw + 1, length - 1) == 0)
+    {
+        s.method = CHUNK_FILL;
+        s.packed.assign(1, raw[0]);
+        return;
+    }
+
+    uLongf packedLength = compressBound(length);
+    s.packed.resize(packedLength);
+    if (compress2(s.packed.data(), &packedLength, raw, length, m_level) == Z_OK && packedLength < length)
+    {
+        s.method = CHUNK_DEFLATE;
+        s.packed.resize(packedLength);
+        return;
+    }
+
+    s.method = CHUNK_STORED;
+    s.packed.assign(raw, raw + length);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// stopThreads() - Tells the compressor threads to quit, and waits for them to do so
+//==========================================================================================================
+void CChunkedWriter::stopThreads()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cvWork.notify_all();
+    for (auto& t : m_threads) t.join();
+    m_threads.clear();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// ~CChunkedReader() - Destructor
+//==========================================================================================================
+CChunkedReader::~CChunkedReader()
+{
+    if (m_fd >= 0) ::close(m_fd);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// isChunkedFile() - Returns true if the file begins with the chunked format's magic number
+//==========================================================================================================
+bool CChunkedReader::isChunkedFile(string filename)
+{
+    char magic[sizeof CChunkedWriter::MAGIC];
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool result = ::read(fd, magic, sizeof magic) == sizeof magic
+               && memcmp(magic, CChunkedWriter::MAGIC, sizeof magic) == 0;
+    ::close(fd);
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Opens a chunked file, and reads its header and its index
+//==========================================================================================================
+void CChunkedReader::open(string filename)
+{
+    chunkTrailer_t trailer;
+    struct stat    sb;
+
+    m_filename = filename;
+    m_fd = ::open(filename.c_str(), O_RDONLY);
+    if (m_fd < 0) throwErrno("Can't open", filename, errno);
+    if (fstat(m_fd, &sb) < 0) throwErrno("Can't stat", filename, errno);
+
+    // Read the header and the trailer, and make sure this really is a chunked file
+    uint64_t fileSize = sb.st_size;
+    if (fileSize < sizeof m_header + sizeof trailer) throw runtime_error(filename + " is not a chunked file");
+    readAt(&m_header, sizeof m_header,  0);
+    readAt(&trailer,  sizeof trailer,   fileSize - sizeof trailer);
+    if (memcmp(m_header.magic, CChunkedWriter::MAGIC, sizeof m_header.magic) != 0
+    ||  m_header.frameSize == 0 || m_header.chunkFrames == 0)
+    {
+        throw runtime_error(filename + " is not a chunked file");
+    }
+    if (memcmp(trailer.magic, CChunkedWriter::INDEX_MAGIC, sizeof trailer.magic) != 0)
+    {
+        throw runtime_error(filename + " is truncated");
+    }
+
+    // Read the index, which sits between the last chunk and the trailer
+    uint64_t chunks = (m_header.totalFrames + m_header.chunkFrames - 1) / m_header.chunkFrames;
+    if (trailer.indexOffset + chunks * sizeof(chunkIndex_t) + sizeof trailer != fileSize)
+    {
+        throw runtime_error(filename + " has a damaged index");
+    }
+    m_index.resize(chunks);
+    readAt(m_index.data(), chunks * sizeof(chunkIndex_t), trailer.indexOffset);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// framesInChunk() - Returns the number of frames in a chunk.  Only the last one can be short
+//==========================================================================================================
+uint32_t CChunkedReader::framesInChunk(uint64_t chunk) const
+{
+    uint64_t first = chunk * m_header.chunkFrames;
+    return min<uint64_t>(m_header.chunkFrames, m_header.totalFrames - first);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// readChunk() - Reads a chunk and expands it into the caller's buffer
+//==========================================================================================================
+void CChunkedReader::readChunk(uint64_t chunk, uint8_t* dst) const
+{
+    const chunkIndex_t& ci = m_index[chunk];
+    uint64_t rawLength = (uint64_t)framesInChunk(chunk) * m_header.frameSize;
+    uLongf   length    = rawLength;
+    uint8_t  value;
+
+    switch (ci.method)
+    {
+        case CHUNK_FILL:
+            readAt(&value, 1, ci.offset);
+            memset(dst, value, rawLength);
+            return;
+
+        case CHUNK_STORED:
+            if (ci.length != rawLength) break;
+            readAt(dst, rawLength, ci.offset);
+            return;
+
+        case CHUNK_DEFLATE:
+        {
+            vector<uint8_t> packed(ci.length);
+            readAt(packed.data(), ci.length, ci.offset);
+            if (uncompress(dst, &length, packed.data(), ci.length) != Z_OK || length != rawLength) break;
+            return;
+        }
+    }
+
+    throw runtime_error(m_filename + ": chunk " + to_string(chunk) + " is damaged");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// read() - Fetches a run of consecutive frames, decompressing only the chunks that hold them
+//==========================================================================================================
+void CChunkedReader::read(uint64_t firstFrame, uint64_t count, uint8_t* dst) const
+{
+    if (firstFrame + count > m_header.totalFrames)
+    {
+        throw runtime_error(m_filename + " doesn't have frame " + to_string(firstFrame + count - 1));
+    }
+
+    vector<uint8_t> buffer;
+    uint32_t frameSize = m_header.frameSize;
+
+    while (count)
+    {
+        uint64_t chunk      = firstFrame / m_header.chunkFrames;
+        uint64_t chunkFirst = chunk * m_header.chunkFrames;
+        uint32_t chunkCount = framesInChunk(chunk);
+        uint64_t skip       = firstFrame - chunkFirst;
+        uint64_t frames     = min<uint64_t>(count, chunkCount - skip);
+
+        // If we want the whole chunk, it can go straight to the caller.  Otherwise, we expand it and
+        // copy out the frames we want
+        if (skip == 0 && frames == chunkCount)
+        {
+            readChunk(chunk, dst);
+        }
+        else
+        {
+            buffer.resize((size_t)chunkCount * frameSize);
+            readChunk(chunk, buffer.data());
+            memcpy(dst, buffer.data() + skip * frameSize, frames * frameSize);
+        }
+
+        dst        += frames * frameSize;
+        firstFrame += frames;
+        count      -= frames;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// readAt() - Reads exactly 'length' bytes from the file at the specified offset
+//==========================================================================================================
+void CChunkedReader::readAt(void* dst, size_t length, uint64_t offset) const
+{
+    uint8_t* p = (uint8_t*)dst;
+    while (length)
+    {
+        ssize_t n = pread(m_fd, p, length, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throwErrno("Can't read", m_filename, errno);
+        if (n == 0) throw runtime_error(m_filename + " is truncated");
+        p      += n;
+        offset += n;
+        length -= n;
+    }
+}
+//==========================================================================================================
@@ -0,0 +1,184 @@
+//==========================================================================================================
+// chunked_file.h - Defines the writer and reader of the "chunked" output format, in which each frame group
+//                  is compressed independently, and an index makes any of them accessible without
+//                  decompressing the others
+//
+// File format (all integers are little-endian):
+//
+//    Header  : 8-byte magic "ESPCHK01", uint32 bytes-per-frame, uint32 frames-per-chunk,
+//              uint64 total frame count
+//    Chunks  : the stored form of each chunk, one after another.  Every chunk holds frames-per-chunk
+//              frames, except the last, which holds whatever is left over
+//    Index   : a chunkIndex_t for each chunk
+//    Trailer : uint64 file offset of the index, followed by the 8-byte magic "ESPCIDX1"
+//
+// A chunk is stored in one of three ways:
+//
+//    CHUNK_STORED  : the raw frames, uncompressed
+//    CHUNK_DEFLATE : the frames compressed with zlib's compress2()
+//    CHUNK_FILL    : a single byte.  Every byte of the chunk has that value
+//
+// The index is at the end so that the file can be written sequentially (even to a stream).  A loader
+// reads the trailer, then the index, and then just the chunks it wants
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include "frame_writer.h"
+
+
+//----------------------------------------------------------------------------------------------------------
+// The on-disk structures of a chunked file
+//----------------------------------------------------------------------------------------------------------
+enum chunkMethod_t : uint32_t {CHUNK_STORED = 0, CHUNK_DEFLATE = 1, CHUNK_FILL = 2};
+
+struct chunkHeader_t
+{
+    char     magic[8];
+    uint32_t frameSize;
+    uint32_t chunkFrames;
+    uint64_t totalFrames;
+};
+
+struct chunkIndex_t
+{
+    uint64_t offset;
+    uint32_t length;
+    uint32_t method;
+};
+
+struct chunkTrailer_t
+{
+    uint64_t indexOffset;
+    char     magic[8];
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CChunkedWriter - Writes frames in the chunked format.  Chunks are compressed on a pool of threads, and
+//                  the results are handed (in order) to some other back-end to be written
+//----------------------------------------------------------------------------------------------------------
+class CChunkedWriter : public CFrameWriter
+{
+public:
+
+    // The magic numbers at the start and the end of every chunked file
+    static const char MAGIC[8];
+    static const char INDEX_MAGIC[8];
+
+    // 'inner' is the back-end that will write the chunked data, and is owned by this object.
+    // 'chunkFrames' is the number of frames in a chunk, and 'level' is the zlib compression level
+    CChunkedWriter(CFrameWriter* inner, uint32_t frameSize, uint32_t chunkFrames, uint32_t threads, int level);
+    ~CChunkedWriter();
+
+    void    open(std::string filename, uint64_t totalBytes);
+    void    write(const uint8_t* data, size_t length);
+    void    close();
+
+protected:
+
+    // A chunk on its way through the compressor threads
+    struct slot_t
+    {
+        std::vector<uint8_t> raw, packed;
+        size_t          rawLength;
+        uint32_t        method;
+        bool            compressed;
+    };
+
+    // Hands the chunk being filled to the compressor threads, and starts filling the next one
+    void    submitChunk();
+
+    // Writes compressed chunks to the inner back-end, in order.  If 'all' is false, this stops at
+    // the first chunk that isn't ready yet, and otherwise it waits for every submitted chunk
+    void    writeChunks(bool all);
+
+    // This is the code that each compressor thread runs
+    void    compressorThread();
+
+    // Compresses the chunk in a slot
+    void    compress(slot_t& s);
+
+    // Stops the compressor threads
+    void    stopThreads();
+
+    // The back-end that writes the chunked data
+    std::unique_ptr<CFrameWriter> m_inner;
+
+    // The number of bytes in a frame and in a full chunk, and the zlib compression level
+    uint32_t    m_frameSize;
+    uint32_t    m_chunkFrames;
+    uint64_t    m_chunkBytes;
+    int         m_level;
+
+    // The ring of chunk buffers, the number of chunks submitted to it, and the number written
+    std::vector<slot_t> m_slot;
+    uint64_t    m_submitted, m_written;
+
+    // The index of every chunk written so far, and the file offset of the next one
+    std::vector<chunkIndex_t> m_index;
+    uint64_t    m_offset;
+
+    // The compressor threads, and the queue of slots waiting to be compressed
+    std::vector<std::thread> m_threads;
+    std::deque<size_t>  m_queue;
+    bool                m_quit;
+    std::mutex          m_mutex;
+    std::condition_variable m_cvWork, m_cvDone;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CChunkedReader - Reads the frames of a chunked file, decompressing only the chunks that are needed.
+//                  After open(), any number of threads can call readChunk() at the same time
+//----------------------------------------------------------------------------------------------------------
+class CChunkedReader
+{
+public:
+
+    CChunkedReader() {m_fd = -1;}
+    ~CChunkedReader();
+
+    // Returns true if the file exists and is a chunked file
+    static bool isChunkedFile(std::string filename);
+
+    // Opens a chunked file and reads its index.  Can throw exception runtime_error
+    void        open(std::string filename);
+
+    // The shape of the file
+    uint32_t    frameSize()   const {return m_header.frameSize;}
+    uint32_t    chunkFrames() const {return m_header.chunkFrames;}
+    uint64_t    frameCount()  const {return m_header.totalFrames;}
+    uint64_t    chunkCount()  const {return m_index.size();}
+
+    // The number of frames in a particular chunk
+    uint32_t    framesInChunk(uint64_t chunk) const;
+
+    // Decompresses a chunk into 'dst', which must have room for framesInChunk() frames.   Can throw
+    // exception runtime_error
+    void        readChunk(uint64_t chunk, uint8_t* dst) const;
+
+    // Fetches 'count' consecutive frames, starting at 'firstFrame'.   Can throw exception runtime_error
+    void        read(uint64_t firstFrame, uint64_t count, uint8_t* dst) const;
+
+protected:
+
+    // Reads exactly 'length' bytes at 'offset'.   Can throw exception runtime_error
+    void        readAt(void* dst, size_t length, uint64_t offset) const;
+
+    std::string     m_filename;
+    int             m_fd;
+    chunkHeader_t   m_header;
+    std::vector<chunkIndex_t> m_index;
+};
+//----------------------------------------------------------------------------------------------------------
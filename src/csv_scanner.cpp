@@ -0,0 +1,96 @@
+//==========================================================================================================
+// csv_scanner.cpp - Implements the memory-mapped input file
+//==========================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csv_scanner.h"
+
+using namespace std;
+
+
+//==========================================================================================================
+// open() - Maps the entire file into memory
+//==========================================================================================================
+bool CMappedFile::open(string filename)
+{
+    // Get rid of any file that's already mapped
+    close();
+
+    // Open the file
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    // Find out how big it is
+    struct stat sb;
+    if (fstat(fd, &sb) < 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // An empty file doesn't get mapped
+    m_size = sb.st_size;
+    if (m_size == 0)
+    {
+        ::close(fd);
+        return true;
+    }
+
+    // Map the file, and tell the kernel we're going to read it from front to back
+    void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        m_size = 0;
+        return false;
+    }
+    madvise(p, m_size, MADV_SEQUENTIAL);
+
+    m_data = (const char*)p;
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close() - Unmaps the file
+//==========================================================================================================
+void CMappedFile::close()
+{
+    if (m_data) munmap((void*)m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// split() - Divides the file into pieces that begin on line boundaries
+//==========================================================================================================
+vector<const char*> CMappedFile::split(int count) const
+{
+    vector<const char*> result;
+
+    result.push_back(begin());
+
+    for (int i=1; i<count; ++i)
+    {
+        // Start with a rough guess at where this piece begins
+        const char* p = begin() + (m_size / count) * i;
+
+        // Move it forward to the start of the next line.  An empty file isn't mapped, so there's
+        // nothing to search
+        if (p < result.back()) p = result.back();
+        const char* lf = (p < end()) ? (const char*)memchr(p, 10, end() - p) : nullptr;
+        p = lf ? lf + 1 : end();
+
+        result.push_back(p);
+    }
+
+    result.push_back(end());
+    return result;
+}
+//==========================================================================================================
@@ -0,0 +1,156 @@
+//==========================================================================================================
+// csv_scanner.h - Defines a fast, allocation-free scanner for the comma-separated input files
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <limits.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <string.h>
+
+
+//----------------------------------------------------------------------------------------------------------
+// CMappedFile - Maps an entire file into memory, read-only
+//----------------------------------------------------------------------------------------------------------
+class CMappedFile
+{
+public:
+
+    CMappedFile() {m_data = nullptr; m_size = 0;}
+    ~CMappedFile() {close();}
+
+    // Call this to map a file.  Returns 'true' on success, 'false' if the file can't be opened
+    bool        open(std::string filename);
+
+    // Call this to unmap the file
+    void        close();
+
+    // The first byte of the file, and the byte just past the end of it
+    const char* begin() const {return m_data;}
+    const char* end()   const {return m_data + m_size;}
+
+    // Splits the file into (about) 'count' pieces that each begin at the start of a line.
+    // Piece 'i' runs from element 'i' of the result to element 'i+1'
+    std::vector<const char*> split(int count) const;
+
+protected:
+
+    const char* m_data;
+    size_t      m_size;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CCsvScanner - Extracts comma-separated tokens from a single line of text that is already in memory
+//
+// Tokens are delimited exactly as getNextCommaSeparatedToken() delimits them: leading and trailing spaces
+// and tabs are ignored, a token ends at a comma, space, tab, CR, LF or NUL, and the line ends at a CR, LF,
+// NUL, or the 'end' pointer.  An empty token between two commas is a valid token
+//----------------------------------------------------------------------------------------------------------
+class CCsvScanner
+{
+public:
+
+    // 'p' is the start of the text to scan, 'end' is just past the end of it
+    CCsvScanner(const char* p, const char* end) {m_p = p; m_end = end;}
+
+    // Skips over spaces and tabs
+    void        skipWhitespace() {while (m_p < m_end && (*m_p == 32 || *m_p == 9)) ++m_p;}
+
+    // Returns true if there's nothing left on the line
+    bool        atEnd() const {return m_p == m_end || *m_p == 0 || *m_p == 10 || *m_p == 13;}
+
+    // Returns true if the rest of the line is blank or is a comment
+    bool        isBlankOrComment()
+    {
+        skipWhitespace();
+        if (atEnd() || *m_p == '#') return true;
+        return m_p[0] == '/' && m_p + 1 < m_end && m_p[1] == '/';
+    }
+
+    // Fetches the next token.  Returns false if there isn't one
+    bool        nextToken(std::string_view& token)
+    {
+        // Skip over white-space, and tell the caller if we've hit the end of the line
+        skipWhitespace();
+        if (atEnd())
+        {
+            token = std::string_view();
+            return false;
+        }
+
+        // Find the end of the token
+        const char* start = m_p;
+        while (m_p < m_end && !isDelimiter(*m_p)) ++m_p;
+        token = std::string_view(start, m_p - start);
+
+        // Skip over any trailing whitespace and the comma, if there is one
+        skipWhitespace();
+        if (m_p < m_end && *m_p == ',') ++m_p;
+        return true;
+    }
+
+    // Fetches the next token and converts it to an integer, as atoi() would.  If there is no token,
+    // the value is 0 and this returns false
+    bool        nextInt(int* pValue)
+    {
+        std::string_view token;
+        bool status = nextToken(token);
+        *pValue = toInt(token);
+        return status;
+    }
+
+    // The position of the next character to be scanned
+    const char* position() const {return m_p;}
+
+    // Converts text to an integer with the same results as atoi()
+    static int  toInt(std::string_view text)
+    {
+        const char* p   = text.data();
+        const char* end = p + text.size();
+
+        // Skip over leading white-space, then fetch the sign
+        while (p < end && (*p == 32 || (*p >= 9 && *p <= 13))) ++p;
+        bool negative = (p < end && *p == '-');
+        if (p < end && (*p == '-' || *p == '+')) ++p;
+        if (p == end || *p < '0' || *p > '9') return 0;
+
+        // Convert the digits.  Out-of-range values saturate, just as they do in strtol()
+        uint64_t magnitude = 0;
+        auto result = std::from_chars(p, end, magnitude);
+        if (result.ec == std::errc::result_out_of_range) magnitude = UINT64_MAX;
+        if (negative) return (int)(magnitude > (uint64_t)LONG_MAX ? LONG_MIN : -(int64_t)magnitude);
+        return (int)(magnitude > (uint64_t)LONG_MAX ? LONG_MAX : (int64_t)magnitude);
+    }
+
+protected:
+
+    // Returns true if 'c' ends a token
+    static bool isDelimiter(char c) {return c == ',' || c == 32 || c == 9 || c == 10 || c == 13 || c == 0;}
+
+    const char* m_p;
+    const char* m_end;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// nextLine() - Finds the line that starts at 'p', and advances 'p' to the start of the next line.
+//              Returns a pointer just past the end of the line's text
+//
+// Like std::getline(), lines end at an LF.  As with a std::string's c_str(), a NUL ends the text
+//----------------------------------------------------------------------------------------------------------
+inline const char* nextLine(const char*& p, const char* end)
+{
+    const char* lf = (const char*)memchr(p, 10, end - p);
+    const char* lineEnd = lf ? lf : end;
+    const char* nul = (const char*)memchr(p, 0, lineEnd - p);
+    p = lf ? lf + 1 : end;
+    return nul ? nul : lineEnd;
+}
+//----------------------------------------------------------------------------------------------------------
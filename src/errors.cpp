@@ -0,0 +1,18 @@
+//==========================================================================================================
+// errors.cpp - Implements the helpers that turn system-call failures into exceptions
+//==========================================================================================================
+#include <string.h>
+#include <stdexcept>
+#include "errors.h"
+
+using namespace std;
+
+
+//==========================================================================================================
+// throwErrno() - Throws a runtime_error that describes what we were doing and the value of errno
+//==========================================================================================================
+void throwErrno(const char* action, const string& filename, int error)
+{
+    throw runtime_error(string(action) + " " + filename + ": " + strerror(error));
+}
+//==========================================================================================================
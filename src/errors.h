@@ -0,0 +1,13 @@
+//==========================================================================================================
+// errors.h - Defines the helpers that turn system-call failures into exceptions
+//==========================================================================================================
+#pragma once
+#include <string>
+
+
+//----------------------------------------------------------------------------------------------------------
+// throwErrno() - Throws a runtime_error that describes what we were doing and the value of errno.  'error'
+//                is that value, and 'filename' names the file (or whatever else) we were doing it to
+//----------------------------------------------------------------------------------------------------------
+void throwErrno(const char* action, const std::string& filename, int error);
+//----------------------------------------------------------------------------------------------------------
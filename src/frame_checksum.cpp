@@ -0,0 +1,303 @@
+//==========================================================================================================
+// frame_checksum.cpp - Implements CRC32C checksums of the frame groups of an output file
+//==========================================================================================================
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "frame_checksum.h"
+#include "errors.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_CRC
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HAVE_ARM_CRC
+#endif
+
+using namespace std;
+
+// The CRC32C polynomial, bit-reversed
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+
+// A CRC kernel takes the CRC that has been inverted (as CRC32C requires) and returns it the same way
+typedef uint32_t (*crcKernel_t)(uint32_t crc, const uint8_t* p, size_t length);
+
+
+//==========================================================================================================
+// crcTable() - Returns the "slice-by-8" lookup tables that the portable kernel uses.   table[0] is the
+//              ordinary byte-at-a-time table, and table[k] advances a byte through k more zero bytes
+//==========================================================================================================
+static const uint32_t (*crcTable())[256]
+{
+    static uint32_t table[8][256];
+    static bool     ready = []
+    {
+        for (uint32_t i=0; i<256; ++i)
+        {
+            uint32_t crc = i;
+            for (int bit=0; bit<8; ++bit) crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+            table[0][i] = crc;
+        }
+        for (uint32_t i=0; i<256; ++i)
+        {
+            for (int k=1; k<8; ++k) table[k][i] = (table[k-1][i] >> 8) ^ table[0][table[k-1][i] & 0xFF];
+        }
+        return true;
+    }();
+    (void)ready;
+    return table;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// crcPortable() - The kernel that works on any CPU: processes 8 bytes per step with slice-by-8 tables
+//==========================================================================================================
+static uint32_t crcPortable(uint32_t crc, const uint8_t* p, size_t length)
+{
+    auto table = crcTable();
+
+    while (length >= 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24]
+            ^ table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+        p      += 8;
+        length -= 8;
+    }
+
+    while (length--) crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+//==========================================================================================================
+
+
+#ifdef HAVE_X86_CRC
+//==========================================================================================================
+// crcSse42() - The kernel that uses the SSE4.2 CRC32 instruction, 8 bytes at a time
+//==========================================================================================================
+__attribute__((target("sse4.2")))
+static uint32_t crcSse42(uint32_t crc, const uint8_t* p, size_t length)
+{
+    uint64_t crc64 = crc;
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64   = _mm_crc32_u64(crc64, word);
+        p      += 8;
+        length -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+    while (length--) crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+//==========================================================================================================
+#endif
+
+
+#ifdef HAVE_ARM_CRC
+//==========================================================================================================
+// crcArm() - The kernel that uses the ARMv8 CRC32C instructions, 8 bytes at a time
+//==========================================================================================================
+static uint32_t crcArm(uint32_t crc, const uint8_t* p, size_t length)
+{
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc     = __crc32cd(crc, word);
+        p      += 8;
+        length -= 8;
+    }
+
+    while (length--) crc = __crc32cb(crc, *p++);
+    return crc;
+}
+//==========================================================================================================
+#endif
+
+
+//==========================================================================================================
+// crc32c() - Computes the CRC32C of a block of data, continuing from a previous checksum
+//==========================================================================================================
+uint32_t crc32c(uint32_t crc, const void* data, size_t length)
+{
+    // The first time through, pick the fastest kernel that this CPU supports
+    static const crcKernel_t kernel = []
+    {
+        #ifdef HAVE_X86_CRC
+            if (__builtin_cpu_supports("sse4.2")) return (crcKernel_t)crcSse42;
+        #endif
+        #ifdef HAVE_ARM_CRC
+            return (crcKernel_t)crcArm;
+        #endif
+        return (crcKernel_t)crcPortable;
+    }();
+
+    return ~kernel(~crc, (const uint8_t*)data, length);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// writeChecksumFile() - Writes a checksum file.  After a comment that says what it describes, there's a
+//                       line for each frame group: its index, its offset and length in the output file,
+//                       and its CRC32C in hex
+//==========================================================================================================
+void writeChecksumFile(string filename, string describes, const vector<groupChecksum_t>& list)
+{
+    FILE* ofile = fopen(filename.c_str(), "w");
+    if (ofile == nullptr) throwErrno("Can't create", filename, errno);
+
+    fprintf(ofile, "# CRC32C of each frame group of %s\n", describes.c_str());
+    fprintf(ofile, "# group offset length crc32c\n");
+    for (auto& gc : list) fprintf(ofile, "%u %lu %lu %08x\n", gc.group, gc.offset, gc.length, gc.crc);
+
+    if (fclose(ofile) != 0) throwErrno("Can't write", filename, errno);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// readChecksumFile() - Reads a checksum file that was written by writeChecksumFile()
+//
+// Returns: false if the file doesn't exist
+//==========================================================================================================
+bool readChecksumFile(string filename, vector<groupChecksum_t>& list)
+{
+    char line[256];
+
+    list.clear();
+
+    FILE* ifile = fopen(filename.c_str(), "r");
+    if (ifile == nullptr)
+    {
+        if (errno == ENOENT) return false;
+        throwErrno("Can't open", filename, errno);
+    }
+
+    while (fgets(line, sizeof line, ifile))
+    {
+        // Skip comments and blank lines
+        const char* p = line;
+        while (*p == ' ') ++p;
+        if (*p == '#' || *p == '\n' || *p == 0) continue;
+
+        groupChecksum_t gc;
+        if (sscanf(p, "%u %lu %lu %x", &gc.group, &gc.offset, &gc.length, &gc.crc) != 4)
+        {
+            fclose(ifile);
+            throw runtime_error("Malformed line in " + filename + ": " + line);
+        }
+        list.push_back(gc);
+    }
+
+    fclose(ifile);
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// CChecksumWriter() - Constructor
+//==========================================================================================================
+CChecksumWriter::CChecksumWriter(CFrameWriter* inner, uint64_t groupBytes, uint32_t firstGroup)
+    : m_inner(inner)
+{
+    m_groupBytes = groupBytes;
+    m_firstGroup = firstGroup;
+    m_crc        = 0;
+    m_partial    = 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// write() - Checksums the data, then writes it via the inner back-end
+//==========================================================================================================
+void CChecksumWriter::write(const uint8_t* data, size_t length)
+{
+    m_inner->write(data, length);
+
+    while (length)
+    {
+        // Checksum as much of the data as belongs to the current frame group
+        size_t n = min<uint64_t>(length, m_groupBytes - m_partial);
+        m_crc = crc32c(m_crc, data, n);
+        m_partial += n;
+        data      += n;
+        length    -= n;
+
+        // If that completed the frame group, record its checksum
+        if (m_partial == m_groupBytes) finishGroup();
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close() - Records the checksum of any partial frame group, then closes the inner back-end
+//==========================================================================================================
+void CChecksumWriter::close()
+{
+    if (m_partial) finishGroup();
+    m_inner->close();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// finishGroup() - Records the checksum of the frame group that has just been written
+//==========================================================================================================
+void CChecksumWriter::finishGroup()
+{
+    uint32_t index = m_list.size();
+    m_list.push_back({m_firstGroup + index, index * m_groupBytes, m_partial, m_crc});
+    m_crc     = 0;
+    m_partial = 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// checksumMapped() - Checksums the frame groups of a memory-mapped output file.   Threads claim frame
+//                    groups one at a time, so the work stays balanced
+//==========================================================================================================
+void CChecksumWriter::checksumMapped(uint64_t totalBytes, uint32_t threads)
+{
+    const uint8_t* base = m_inner->mappedBase();
+    uint64_t groupCount = (totalBytes + m_groupBytes - 1) / m_groupBytes;
+
+    m_list.resize(groupCount);
+
+    atomic<uint64_t> nextGroup(0);
+    auto worker = [&]()
+    {
+        for (uint64_t i = nextGroup++; i < groupCount; i = nextGroup++)
+        {
+            uint64_t offset = i * m_groupBytes;
+            uint64_t length = min(m_groupBytes, totalBytes - offset);
+            m_list[i] = {m_firstGroup + (uint32_t)i, offset, length, crc32c(0, base + offset, length)};
+        }
+    };
+
+    vector<thread> pool;
+    for (uint32_t i=1; i<threads; ++i) pool.push_back(thread(worker));
+    worker();
+    for (auto& t : pool) t.join();
+}
+//==========================================================================================================
@@ -0,0 +1,85 @@
+//==========================================================================================================
+// frame_checksum.h - Defines the CRC32C checksums that are kept of each frame group of an output file
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "frame_writer.h"
+
+
+// Computes the CRC32C (Castagnoli) checksum of 'length' bytes, continuing from 'crc', which is the
+// checksum of whatever came before (or 0 if there's nothing before).  Uses the SSE4.2 or ARMv8 CRC
+// instructions when the CPU has them
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+
+
+//----------------------------------------------------------------------------------------------------------
+// groupChecksum_t - The checksum of one frame group of an output file
+//----------------------------------------------------------------------------------------------------------
+struct groupChecksum_t
+{
+    // The index of the frame group within the image
+    uint32_t    group;
+
+    // Where the frame group is in the output file, and how many bytes it occupies
+    uint64_t    offset, length;
+
+    // The CRC32C of those bytes
+    uint32_t    crc;
+};
+
+// Writes a checksum file, one line per frame group.   Can throw exception runtime_error
+void writeChecksumFile(std::string filename, std::string describes, const std::vector<groupChecksum_t>& list);
+
+// Reads a checksum file.  Returns false if the file doesn't exist.   Can throw exception runtime_error
+bool readChecksumFile(std::string filename, std::vector<groupChecksum_t>& list);
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CChecksumWriter - Wraps an open back-end, and computes the checksum of each frame group as the data is
+//                   written through it.
+//
+// If the back-end is memory-mapped, the frames are built directly into the mapping rather than written,
+// so call checksumMapped() once the mapping has been filled
+//----------------------------------------------------------------------------------------------------------
+class CChecksumWriter : public CFrameWriter
+{
+public:
+
+    // 'inner' is an open back-end and is owned by this object.  'groupBytes' is the size of a frame
+    // group, and 'firstGroup' is the index of the first frame group that will be written
+    CChecksumWriter(CFrameWriter* inner, uint64_t groupBytes, uint32_t firstGroup);
+
+    void     open(std::string filename, uint64_t totalBytes) {m_inner->open(filename, totalBytes);}
+    void     write(const uint8_t* data, size_t length);
+    void     close();
+    uint8_t* mappedBase() {return m_inner->mappedBase();}
+
+    // Checksums the first 'totalBytes' of the mapping, sharing the work among 'threads' threads
+    void     checksumMapped(uint64_t totalBytes, uint32_t threads);
+
+    // The checksum of every frame group that has been written
+    const std::vector<groupChecksum_t>& checksums() const {return m_list;}
+
+protected:
+
+    // Records the checksum of the frame group that has just been completed
+    void     finishGroup();
+
+    // The back-end that actually writes the data
+    std::unique_ptr<CFrameWriter> m_inner;
+
+    // The size of a frame group, the index of the first one, and the checksums so far
+    uint64_t m_groupBytes;
+    uint32_t m_firstGroup;
+    std::vector<groupChecksum_t> m_list;
+
+    // The checksum of the frame group being written, and how many of its bytes have been written
+    uint32_t m_crc;
+    uint64_t m_partial;
+};
+//----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,1636 @@
+//===================================================================================================================
+// frame_generator.cpp - Implements CFrameGenerator
+//===================================================================================================================
+#include <stdio.h>
+#include <string.h>
+#include <cstdarg>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+#include <charconv>
+#include "frame_generator.h"
+#include "config_file.h"
+#include "csv_scanner.h"
+
+using namespace std;
+
+// The "magic number" that identifies a compiled-distribution file, and its version
+static const char CACHE_MAGIC[8] = {'E', 'S', 'P', 'D', 'I', 'S', 'T', '3'};
+
+
+//==========================================================================================================
+// throwRuntime() - Throws a runtime exception
+//==========================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CFrameGenerator() - Constructor
+//==========================================================================================================
+CFrameGenerator::CFrameGenerator(const config_t& config, const generatorOptions_t& options)
+{
+    m_config  = config;
+    m_options = options;
+    m_inputs  = make_shared<compiledInputs_t>();
+
+    // A frame is made of whole rows
+    if (m_config.cells_per_frame == 0 || m_config.cells_per_frame % ROW_SIZE != 0)
+    {
+        throwRuntime("Config value 'cells_per_frame' must be a multiple of %i", ROW_SIZE);
+    }
+
+    // A frame group has to have room for data
+    if (m_config.data_frames == 0) throwRuntime("Config value 'data_frames' must be non-zero");
+
+    // Decide how cell data gets into the proper order for LVDS transmission from the ECD to the
+    // FPGA: either frames are built that way, or a kernel re-orders each row after it's built
+    m_lvdsFused       = m_options.lvds && m_options.lvdsKernel == "fused";
+    m_lvdsReorderPass = m_options.lvds && !m_lvdsFused;
+    m_lvdsKernel      = m_lvdsReorderPass ? selectLvdsKernel(m_options.lvdsKernel) : nullptr;
+
+    // Build the frames in which every cell holds a diagnostic value, and the quiescent frame.  A 
+    // uniform frame is unaffected by LVDS re-ordering
+    for (uint8_t value : m_config.diagnostic_values)
+    {
+        m_uniformFrame[value].assign(m_config.cells_per_frame, value);
+    }
+    m_uniformFrame[m_config.quiescent].assign(m_config.cells_per_frame, m_config.quiescent);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CFrameGenerator() - Constructor.  Builds frames from the already loaded definitions of 'source'
+//
+// The compiled fragment and distribution definitions don't depend on how the image is laid out, so
+// this generator can lay them out differently (as long as frames are the same size) without loading
+// them again
+//==========================================================================================================
+CFrameGenerator::CFrameGenerator(const config_t& config, const CFrameGenerator& source,
+                                 const generatorOptions_t& options) : CFrameGenerator(config, options)
+{
+    if (m_config.cells_per_frame != source.m_config.cells_per_frame)
+    {
+        throwRuntime("Config value 'cells_per_frame' must be %u", source.m_config.cells_per_frame);
+    }
+
+    m_inputs = source.m_inputs;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// load() - Loads the fragment and distribution definitions
+//
+// If there's an up-to-date compiled copy of the distribution, this loads it.  Otherwise, it loads
+// the fragment definitions and the fragment sequence distribution definitions, and compiles them
+// for next time
+//==========================================================================================================
+void CFrameGenerator::load()
+{
+    // Without a cache there's nothing to compare the input files to, so don't bother hashing them
+    if (m_config.cache_file.empty())
+    {
+        loadFragments();
+        loadDistribution();
+        return;
+    }
+
+    uint64_t inputHash = hashInputFiles();
+    if (!loadCompiledDistribution(inputHash))
+    {
+        loadFragments();
+        loadDistribution();
+        saveCompiledDistribution(inputHash);
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// fill() - Builds a run of consecutive frames into the caller's buffer
+//
+// Passed: frameIndex = The index of the first frame to build
+//         count      = The number of frames to build
+//         dst        = Where to build them
+//==========================================================================================================
+void CFrameGenerator::fill(uint64_t frameIndex, uint64_t count, uint8_t* dst) const
+{
+    frameBuilder_t fb;
+
+    for (uint64_t i=0; i<count; ++i)
+    {
+        buildFrame(fb, dst, frameIndex + i);
+        dst += m_config.cells_per_frame;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// iterator() - Constructor.  Builds the frame at 'frameIndex', if there is one
+//==========================================================================================================
+CFrameGenerator::iterator::iterator(const CFrameGenerator* generator, uint64_t frameIndex)
+{
+    m_generator  = generator;
+    m_frameIndex = frameIndex;
+    build();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// iterator::build() - Builds the frame that the iterator is positioned at
+//==========================================================================================================
+void CFrameGenerator::iterator::build()
+{
+    // There's nothing to build at the end of the image
+    if (m_frameIndex >= m_generator->frameCount()) return;
+
+    // The first time through, allocate the frame
+    if (m_frame.empty()) m_frame.resize(m_generator->frameSize());
+
+    m_generator->buildFrame(m_builder, m_frame.data(), m_frameIndex);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// readConfigurationFile() - Reads in the configuration file and populates the caller's "config"
+//                           structure
+//==========================================================================================================
+void readConfigurationFile(string filename, config_t& config)
+{
+    CConfigFile cf;
+
+    // Declare a default filename
+    const char* cfilename = "ecd_sample_prep.conf";
+
+    // If the filename passed by the caller isn't blank, that's our filename
+    if (!filename.empty()) cfilename = filename.c_str();
+
+    // Read and parse the configuration file and complain if we can't
+    if (!cf.read(cfilename, false)) throwRuntime("Can't read %s", cfilename);
+
+    // Fetch each configuration
+    cf.get("cells_per_frame",     &config.cells_per_frame    );
+    cf.get("contig_size",         &config.contig_size        );
+    cf.get("data_frames",         &config.data_frames        );
+    cf.get("diagnostic_values",   &config.diagnostic_values  );
+    cf.get("quiescent",           &config.quiescent          );
+    cf.get("fragment_file",       &config.fragment_file      );
+    cf.get("distribution_file",   &config.distribution_file  );
+    cf.get("output_file",         &config.output_file        );
+
+    // These settings are optional, and have default values
+    config.output_mode       = "stdio";
+    config.output_format     = "raw";
+    config.write_buffer_size = 8 * 1024 * 1024;
+    config.uring_queue_depth = 8;
+    config.contig_device     = "/dev/mem";
+    config.contig_offset     = 0;
+    config.cache_file        = "";
+    config.progress_interval = 10;
+    config.frame_cache_size  = 256 * 1024 * 1024;
+    config.checksums         = false;
+    config.compression_level = 1;
+
+    // Fetch the optional settings
+    cf.throw_on_fail(false);
+    cf.get("output_mode",         &config.output_mode        );
+    cf.get("output_format",       &config.output_format      );
+    cf.get("write_buffer_size",   &config.write_buffer_size  );
+    cf.get("uring_queue_depth",   &config.uring_queue_depth  );
+    cf.get("contig_device",       &config.contig_device      );
+    cf.get("contig_offset",       &config.contig_offset      );
+    cf.get("cache_file",          &config.cache_file         );
+    cf.get("progress_interval",   &config.progress_interval  );
+    cf.get("frame_cache_size",    &config.frame_cache_size   );
+    cf.get("checksums",           &config.checksums          );
+    cf.get("compression_level",   &config.compression_level  );
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// parsingThreads() - Returns the number of threads that should share the parsing of an input
+//                    file of the specified size
+//==========================================================================================================
+int CFrameGenerator::parsingThreads(size_t fileSize) const
+{
+    // Small files aren't worth the trouble of splitting up
+    if (fileSize < (4 << 20)) return 1;
+    return max(1U, m_options.threads);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// parseNumber() - Converts text to an integer.  Unlike CCsvScanner::toInt(), the whole of the text has
+//                 to be a number
+//
+// Returns: false if the text isn't a number
+//==========================================================================================================
+static bool parseNumber(string_view text, int64_t& value)
+{
+    if (!text.empty() && text[0] == '+') text.remove_prefix(1);
+    if (text.empty() || text[0] == '+') return false;
+    auto result = from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == errc() && result.ptr == text.data() + text.size();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// parseGenerator() - Parses a fragment value, which is either an ordinary value or generates a run of
+//                    values
+//
+// Passed: token  = The token from the fragment definitions file
+//         value  = Receives the value, if the token is an ordinary value
+//         piece  = Receives the piece of the fragment that generates the run, if it isn't
+//         length = Receives the number of values in the run
+//
+// The forms are:
+//     V*N      : the value V, N times
+//     A..B     : every value from A to B (counting down if B is less than A)
+//     A..B:S   : the values from A to B, S apart
+//     A..B*N   : the values from A to B, N times over (A..B:S*N is allowed too)
+//
+// N and S must be at least 1.  Can throw exception runtime_error if the token is neither a whole
+// number (or empty) nor one of these forms, or is one of them but isn't well formed
+//
+// Returns: false if the token isn't one of these, i.e., it's an ordinary value
+//==========================================================================================================
+static bool parseGenerator(string_view token, int64_t& value, segment_t& piece, uint64_t& length)
+{
+    size_t star  = token.find('*');
+    size_t range = token.find("..");
+
+    // Most tokens are ordinary values.  An empty one (between two commas) has always meant 0
+    if (star == string_view::npos && range == string_view::npos)
+    {
+        value = 0;
+        if (!token.empty() && !parseNumber(token, value)) throw runtime_error("Invalid value '" + string(token) + "'");
+        return false;
+    }
+
+    const string invalid = "Invalid value '" + string(token) + "'";
+
+    // Fetch the repeat count, if there is one
+    int64_t count = 1;
+    if (star != string_view::npos)
+    {
+        if (!parseNumber(token.substr(star + 1), count) || count < 1 || count > UINT32_MAX) throw runtime_error(invalid);
+        token = token.substr(0, star);
+        range = token.find("..");
+    }
+
+    piece.kind = SEGMENT_RAMP;
+
+    // A single value that's repeated
+    if (range == string_view::npos)
+    {
+        if (!parseNumber(token, value)) throw runtime_error(invalid);
+        piece.origin = value;
+        piece.step   = 0;
+        piece.period = 1;
+        length       = count;
+        return true;
+    }
+
+    // A ramp.  The step is the distance between values, and its sign comes from the direction
+    size_t  colon = token.find(':', range);
+    int64_t first, last, step = 1;
+    bool ok = parseNumber(token.substr(0, range), first);
+    ok = ok && parseNumber(token.substr(range + 2, colon == string_view::npos ? colon : colon - range - 2), last);
+    if (colon != string_view::npos) ok = ok && parseNumber(token.substr(colon + 1), step);
+    if (!ok || step < 1 || step > INT32_MAX) throw runtime_error(invalid);
+
+    uint64_t values = ((last < first ? first - last : last - first) / step) + 1;
+    if (values > UINT32_MAX) throw runtime_error(invalid);
+
+    piece.origin = first;
+    piece.step   = (uint8_t)((last < first) ? -step : step);
+    piece.period = values;
+    length       = values * count;
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// loadFragments() - Load fragment definitions into RAM
+//
+// On Exit: m_inputs->fragmentTable, fragmentId, fragmentPieces and fragmentArena contain the fragment
+//          definitions
+//
+// The file is mapped into memory and scanned in place.  With more than one thread, a large file is split
+// into pieces that are parsed in parallel, and the results are then merged in order so that a
+// fragment that is defined more than once still ends up with its last definition
+//
+// A fragment is stored as a list of pieces.  A run of ordinary values is a piece whose values are in
+// the fragment arena, and each repeat or ramp (see parseGenerator) is a piece that computes its
+// values, so that it takes no more memory however long it is
+//==========================================================================================================
+void CFrameGenerator::loadFragments()
+{
+    // This is what gets parsed out of each piece of the file
+    struct piece_t
+    {
+        vector<uint8_t>                       arena;
+        vector<segment_t>                     pieces;
+        vector<pair<string_view, fragment_t>> def;
+        string                                error;
+    };
+
+    CMappedFile file;
+
+    // Fetch the filename of the fragment definiton file
+    const char* filename = m_config.fragment_file.c_str();
+
+    // Map the input file into memory, and complain if we can't
+    if (!file.open(filename)) throwRuntime("%s not found", filename);
+
+    // Split the file into pieces that can be parsed independently
+    vector<const char*> boundary = file.split(parsingThreads(file.end() - file.begin()));
+    vector<piece_t> piece(boundary.size() - 1);
+
+    // This parses a single piece of the file.  It stops at the first error it finds
+    auto parse = [&](int index)
+    {
+        piece_t& out = piece[index];
+        string_view name, token;
+        const char* end = boundary[index + 1];
+
+        // Loop through each line of this piece
+        for (const char* p = boundary[index]; p < end;)
+        {
+            const char* lineStart = p;
+            CCsvScanner line(lineStart, nextLine(p, end));
+
+            // Skip blank lines and lines that are comments
+            if (line.isBlankOrComment()) continue;
+
+            // Fetch the fragment name.  If the fragment name is blank, skip this line
+            line.nextToken(name);
+            if (name.empty()) continue;
+
+            // Fetch every value after the name.  Consecutive ordinary values go into the same piece
+            fragment_t frag = {};
+            frag.firstPiece = out.pieces.size();
+            uint64_t length = 0;
+            uint32_t valuesStart = out.arena.size();
+
+            // This ends the run of ordinary values that's being collected, if there is one
+            auto endValues = [&]()
+            {
+                uint32_t count = out.arena.size() - valuesStart;
+                if (count == 0) return;
+                length += count;
+                out.pieces.push_back({valuesStart, (uint32_t)length, count, SEGMENT_VALUES, 0});
+            };
+
+            while (line.nextToken(token))
+            {
+                int64_t   value;
+                segment_t generator;
+                uint64_t  runLength;
+                bool      isGenerator;
+                try
+                {
+                    isGenerator = parseGenerator(token, value, generator, runLength);
+                }
+                catch (const exception& e)
+                {
+                    out.error = "Fragment '" + string(name) + "': " + e.what();
+                    return;
+                }
+
+                if (!isGenerator)
+                {
+                    out.arena.push_back(value);
+                    continue;
+                }
+
+                endValues();
+                valuesStart = out.arena.size();
+                length += runLength;
+                generator.end = length;
+                out.pieces.push_back(generator);
+            }
+            endValues();
+
+            // Positions within a sequence are 32-bit
+            if (length > UINT32_MAX)
+            {
+                out.error = "Fragment '" + string(name) + "' is too long";
+                return;
+            }
+            frag.pieceCount = out.pieces.size() - frag.firstPiece;
+            frag.length     = length;
+
+            // And keep track of this definition
+            out.def.push_back({name, frag});
+        }
+    };
+
+    // Parse the pieces, in parallel if there's more than one
+    vector<thread> worker;
+    for (size_t i=1; i<piece.size(); ++i) worker.emplace_back(parse, i);
+    parse(0);
+    for (auto& t : worker) t.join();
+
+    // Merge the pieces together, in the order they appear in the file
+    compiledInputs_t& in = *m_inputs;
+    for (auto& pc : piece)
+    {
+        uint32_t base      = in.fragmentArena.size();
+        uint32_t pieceBase = in.fragmentPieces.size();
+        in.fragmentArena.insert(in.fragmentArena.end(), pc.arena.begin(), pc.arena.end());
+        for (auto fp : pc.pieces)
+        {
+            if (fp.kind == SEGMENT_VALUES) fp.origin += base;
+            in.fragmentPieces.push_back(fp);
+        }
+
+        for (auto& def : pc.def)
+        {
+            // Find this fragment's ID, allocating a new one if we haven't seen this name before
+            auto it = in.fragmentId.find(def.first);
+            if (it == in.fragmentId.end())
+            {
+                in.fragmentNames.emplace_back(def.first);
+                it = in.fragmentId.emplace(in.fragmentNames.back(), in.fragmentTable.size()).first;
+                in.fragmentTable.push_back({});
+            }
+
+            // If the fragment is being redefined, the new definition replaces the old one
+            fragment_t frag = def.second;
+            frag.firstPiece += pieceBase;
+            if (frag.pieceCount) frag.head = in.fragmentPieces[frag.firstPiece];
+            in.fragmentTable[it->second] = frag;
+        }
+
+        if (!pc.error.empty()) throwRuntime("%s", pc.error.c_str());
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// hashBytes() - Computes a fast non-cryptographic 64-bit hash of a block of memory
+//==========================================================================================================
+static uint64_t hashBytes(const char* p, size_t length, uint64_t hash)
+{
+    const uint64_t K1 = 0x9E3779B97F4A7C15, K2 = 0xBF58476D1CE4E5B9;
+    uint64_t word;
+
+    hash ^= length * K1;
+
+    // Mix in the data eight bytes at a time
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        memcpy(&word, p, 8);
+        hash = (hash ^ (word * K1));
+        hash = ((hash << 29) | (hash >> 35)) * K2;
+    }
+
+    // Then mix in whatever is left over
+    word = 0;
+    if (length) memcpy(&word, p, length);
+    hash = (hash ^ (word * K1));
+    hash = ((hash << 29) | (hash >> 35)) * K2;
+
+    // And make sure every bit of the result depends on every bit of the data
+    hash ^= hash >> 31;
+    hash *= K1;
+    hash ^= hash >> 29;
+    return hash;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// hashInputFiles() - Returns a hash of the fragment and distribution definition files, along with
+//                    the settings that affect how they are compiled
+//==========================================================================================================
+uint64_t CFrameGenerator::hashInputFiles() const
+{
+    uint64_t hash = m_config.cells_per_frame;
+
+    for (auto& filename : {m_config.fragment_file, m_config.distribution_file})
+    {
+        CMappedFile file;
+        if (!file.open(filename)) throwRuntime("%s not found", filename.c_str());
+        hash = hashBytes(file.begin(), file.end() - file.begin(), hash);
+    }
+
+    return hash;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// hashLayout() - Returns a hash of everything other than the distribution that determines where
+//                data frames are in the output file and where cells are within them
+//==========================================================================================================
+uint64_t CFrameGenerator::hashLayout() const
+{
+    vector<uint32_t> layout = 
+    {
+        m_config.cells_per_frame, m_config.data_frames, m_config.quiescent, !m_options.lvds, frameGroupCount()
+    };
+    layout.insert(layout.end(), m_config.diagnostic_values.begin(), m_config.diagnostic_values.end());
+
+    return hashBytes((const char*)layout.data(), layout.size() * sizeof(uint32_t), 0);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// readCompiledDistribution() - Reads a compiled-distribution file
+//
+// Passed: filename = The name of the compiled-distribution file
+//         accept   = Called with the file's header.  Returns false if the file is of no use
+//         list     = Receives the distribution records
+//
+// The file's fragment arena and piece table are appended to ours, and the records in 'list' refer
+// to them
+//
+// Returns: true if the file was read, false if it doesn't exist, isn't valid, or isn't accepted
+//==========================================================================================================
+bool CFrameGenerator::readCompiledDistribution(string filename, function<bool(const cacheHeader_t&)> accept, 
+                                               vector<distribution_t>& list)
+{
+    CMappedFile   file;
+    cacheHeader_t header;
+
+    // If we can't read the file, there's nothing to be had from it
+    if (!file.open(filename)) return false;
+    const char* p    = file.begin();
+    size_t      size = file.end() - file.begin();
+    if (size < sizeof header) return false;
+    memcpy(&header, p, sizeof header);
+
+    // Make sure this is a compiled distribution, and that it's one the caller wants
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof header.magic) != 0 || !accept(header)) return false;
+
+    // Make sure the file is as long as the header says it should be.  None of the counts can be
+    // larger than the file, so the sum below can't overflow
+    if (header.arenaSize > size || header.pieceCount > size || header.recordCount > size || header.segmentCount > size)
+    {
+        return false;
+    }
+    size_t arenaBytes = (header.arenaSize + 7) & ~7ULL;
+    size_t expected   = sizeof header + arenaBytes + header.pieceCount * sizeof(segment_t)
+                      + header.recordCount * sizeof(cacheRecord_t) + header.segmentCount * sizeof(segment_t);
+    if (size != expected) return false;
+
+    // Make sure every record populates only cells that are in the frame, and that every value it
+    // refers to is in the file.  Anything else means the file is stale or corrupt, and is of no use
+    const segment_t*     pieces   = (const segment_t*)(p + sizeof header + arenaBytes);
+    const cacheRecord_t* records  = (const cacheRecord_t*)(pieces + header.pieceCount);
+    const segment_t*     segments = (const segment_t*)(records + header.recordCount);
+
+    // A piece has to have values, and they have to be in the arena
+    auto validPiece = [&](const segment_t& s)
+    {
+        if (s.period == 0) return false;
+        if (s.kind == SEGMENT_VALUES) return s.origin + (uint64_t)s.period <= header.arenaSize;
+        return s.kind == SEGMENT_RAMP;
+    };
+
+    // A repeated fragment's pieces have to be in the piece table, in order, and cover the fragment
+    auto validSegment = [&](const segment_t& s)
+    {
+        if (s.kind != SEGMENT_FRAGMENT) return validPiece(s);
+        if (s.period == 0 || s.step == 0 || s.origin + (uint64_t)s.step > header.pieceCount) return false;
+        for (uint32_t i=1; i<s.step; ++i) if (pieces[s.origin + i].end < pieces[s.origin + i - 1].end) return false;
+        return pieces[s.origin + s.step - 1].end >= s.period;
+    };
+
+    for (uint64_t i=0; i<header.pieceCount; ++i) if (!validPiece(pieces[i])) return false;
+
+    // A record's segments have to be in order, and cover the whole of its sequence
+    uint64_t segmentsSeen = 0;
+    for (uint64_t i=0; i<header.recordCount; ++i)
+    {
+        const cacheRecord_t& r = records[i];
+        if (r.first < 1 || r.last > (int)m_config.cells_per_frame || r.step < 1) return false;
+        if (r.segmentCount > header.segmentCount - segmentsSeen) return false;
+
+        const segment_t* seg = segments + segmentsSeen;
+        for (uint32_t j=0; j<r.segmentCount; ++j)
+        {
+            if (!validSegment(seg[j]) || (j && seg[j].end < seg[j-1].end)) return false;
+        }
+        if (r.length && (r.segmentCount == 0 || seg[r.segmentCount-1].end < r.length)) return false;
+        segmentsSeen += r.segmentCount;
+    }
+    if (segmentsSeen != header.segmentCount) return false;
+
+    // Append this file's fragment arena to ours
+    p += sizeof header;
+    uint32_t base = m_inputs->fragmentArena.size();
+    m_inputs->fragmentArena.insert(m_inputs->fragmentArena.end(), p, p + header.arenaSize);
+    p += arenaBytes;
+
+    // A segment's origin is relative to the file's arena or piece table, so it has to be moved
+    // to where they are in ours
+    uint32_t pieceBase = m_inputs->fragmentPieces.size();
+    auto relocate = [&](segment_t& seg)
+    {
+        if (seg.kind == SEGMENT_VALUES  ) seg.origin += base;
+        if (seg.kind == SEGMENT_FRAGMENT) seg.origin += pieceBase;
+    };
+
+    // Append this file's piece table to ours
+    const segment_t* piece = (const segment_t*)p;
+    m_inputs->fragmentPieces.insert(m_inputs->fragmentPieces.end(), piece, piece + header.pieceCount);
+    for (size_t i = pieceBase; i < m_inputs->fragmentPieces.size(); ++i) relocate(m_inputs->fragmentPieces[i]);
+    p += header.pieceCount * sizeof(segment_t);
+
+    // Load the distribution records and their segments
+    const cacheRecord_t* record  = (const cacheRecord_t*)p;
+    const segment_t*     segment = (const segment_t*)(record + header.recordCount);
+    list.resize(header.recordCount);
+    for (uint64_t i=0; i<header.recordCount; ++i)
+    {
+        auto& dr = list[i];
+        dr.first     = record[i].first;
+        dr.last      = record[i].last;
+        dr.step      = record[i].step;
+        dr.length    = record[i].length;
+        dr.contested = record[i].contested;
+        dr.segment.assign(segment, segment + record[i].segmentCount);
+        for (auto& seg : dr.segment) relocate(seg);
+        segment += record[i].segmentCount;
+    }
+
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// writeCompiledDistribution() - Writes the fragment arena, the piece table, and the distribution list
+//                               to a compiled-distribution file
+//
+// The file is written to a temporary file that is then renamed, so that a partially written file
+// is never mistaken for a complete one.
+//
+// Returns: true on success
+//==========================================================================================================
+bool CFrameGenerator::writeCompiledDistribution(string filename, uint64_t inputHash, uint64_t layoutHash) const
+{
+    cacheHeader_t header = {};
+
+    // Fill in the header
+    memcpy(header.magic, CACHE_MAGIC, sizeof header.magic);
+    header.cellsPerFrame = m_config.cells_per_frame;
+    header.inputHash     = inputHash;
+    header.layoutHash    = layoutHash;
+    header.arenaSize     = m_inputs->fragmentArena.size();
+    header.pieceCount    = m_inputs->fragmentPieces.size();
+    header.recordCount   = m_inputs->distributionList.size();
+    for (auto& dr : m_inputs->distributionList) header.segmentCount += dr.segment.size();
+
+    // Create the temporary file
+    string tempName = filename + ".tmp";
+    FILE* ofile = fopen(tempName.c_str(), "w");
+    if (ofile == nullptr) return false;
+
+    // Write the header and the fragment arena.  An empty vector's data() may be null, and
+    // fwrite() mustn't be handed a null pointer even when there's nothing to write
+    const uint64_t padding = 0;
+    bool ok = fwrite(&header, sizeof header, 1, ofile) == 1;
+    const vector<uint8_t>& arena = m_inputs->fragmentArena;
+    ok = ok && (arena.empty() || fwrite(arena.data(), 1, arena.size(), ofile) == arena.size());
+    ok = ok && fwrite(&padding, 1, -arena.size() & 7, ofile) == (-arena.size() & 7);
+
+    // Write the piece table
+    const vector<segment_t>& pieces = m_inputs->fragmentPieces;
+    ok = ok && (pieces.empty() || fwrite(pieces.data(), sizeof(segment_t), pieces.size(), ofile) == pieces.size());
+
+    // Write the distribution records
+    for (auto& dr : m_inputs->distributionList)
+    {
+        cacheRecord_t record = {dr.first, dr.last, dr.step, dr.length, (uint32_t)dr.segment.size(), dr.contested};
+        ok = ok && fwrite(&record, sizeof record, 1, ofile) == 1;
+    }
+
+    // And write the segments of every record
+    for (auto& dr : m_inputs->distributionList)
+    {
+        if (dr.segment.empty()) continue;
+        ok = ok && fwrite(dr.segment.data(), sizeof(segment_t), dr.segment.size(), ofile) == dr.segment.size();
+    }
+
+    // Close the file and put it in place
+    ok = (fclose(ofile) == 0) && ok;
+    if (ok) ok = (rename(tempName.c_str(), filename.c_str()) == 0);
+    if (!ok) remove(tempName.c_str());
+    return ok;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// loadCompiledDistribution() - If the configuration file names a compiled-distribution cache, and
+//                              it was compiled from the current input files, this loads the
+//                              fragment arena and the distribution list from it
+//
+// Returns: true if the distribution was loaded from the cache
+//==========================================================================================================
+bool CFrameGenerator::loadCompiledDistribution(uint64_t inputHash)
+{
+    // If there's no cache, the distribution has to be compiled from scratch
+    if (m_config.cache_file.empty()) return false;
+
+    // The cache is only of use if it was compiled from the current input files
+    auto isCurrent = [&](const cacheHeader_t& header)
+    {
+        return header.cellsPerFrame == m_config.cells_per_frame && header.inputHash == inputHash;
+    };
+
+    // Try to load it
+    if (!readCompiledDistribution(m_config.cache_file, isCurrent, m_inputs->distributionList)) return false;
+
+    // Build the index that lets frame-builders skip records that have run out of data
+    buildActiveIndex();
+
+    // Find out which record owns each cell
+    resolveCellOwnership();
+
+    printf("Loaded the compiled distribution from %s\n", m_config.cache_file.c_str());
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// saveCompiledDistribution() - If the configuration file names a compiled-distribution cache, this
+//                              writes the fragment arena and the distribution list to it.  Failing
+//                              to write the cache isn't fatal
+//==========================================================================================================
+void CFrameGenerator::saveCompiledDistribution(uint64_t inputHash) const
+{
+    if (m_config.cache_file.empty()) return;
+
+    if (!writeCompiledDistribution(m_config.cache_file, inputHash, 0))
+    {
+        printf("Can't write %s, the compiled distribution won't be saved\n", m_config.cache_file.c_str());
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// loadDistribution() - Loads the fragment distribution definitions into RAM
+//
+// On Exit: m_inputs->distributionList contains the distribution definitions
+//
+// Like loadFragments(), the file is scanned in place, and large files are parsed in parallel 
+// pieces that are merged in order.  If the file contains errors, the first one is reported
+//==========================================================================================================
+void CFrameGenerator::loadDistribution()
+{
+    // This is what gets parsed out of each piece of the file
+    struct piece_t
+    {
+        vector<distribution_t> record;
+        string                 error;
+    };
+
+    CMappedFile file;
+
+    // Fetch the filename of the fragment distribiution definiton file
+    const char* filename = m_config.distribution_file.c_str();
+
+    // Map the input file into memory, and complain if we can't
+    if (!file.open(filename)) throwRuntime("%s not found", filename);
+
+    // Split the file into pieces that can be parsed independently
+    vector<const char*> boundary = file.split(parsingThreads(file.end() - file.begin()));
+    vector<piece_t> piece(boundary.size() - 1);
+
+    // This parses a single piece of the file.  It stops at the first error it finds
+    auto parse = [&](int index)
+    {
+        piece_t& out = piece[index];
+        distribution_t distRecord;
+        string_view fragmentName;
+        const char* end = boundary[index + 1];
+
+        // Loop through each line of this piece
+        for (const char* p = boundary[index]; p < end;)
+        {
+            const char* lineStart = p;
+            const char* lineEnd   = nextLine(p, end);
+
+            // Skip blank lines and lines that are comments
+            CCsvScanner line(lineStart, lineEnd);
+            if (line.isBlankOrComment()) continue;
+
+            // Look for the '$' delimeter that begins a list of fragment IDs
+            const char* delimeter = (const char*)memchr(lineStart, '$', lineEnd - lineStart);
+
+            // If that delimeter doesn't exist, this isn't a valid distribution definition
+            if (delimeter == nullptr) continue;
+
+            // The cell numbers are the part of the line before the '$'
+            CCsvScanner head(line.position(), delimeter);
+
+            // Get the first cell number, the last cell number, and the step-size
+            head.nextInt(&distRecord.first);
+            head.nextInt(&distRecord.last );
+            head.nextInt(&distRecord.step );
+
+            // Ensure that the first cell number in the distribution is valid
+            if (distRecord.first < 1 || distRecord.first > (int)m_config.cells_per_frame)
+            {
+                out.error = "Invalid cell number " + to_string(distRecord.first);
+                return;
+            }
+
+            // If no "last cell" was specified, this distribution is just for the first cell
+            if (distRecord.last == 0) distRecord.last = distRecord.first;
+
+            // A record can't populate cells past the end of the frame
+            if (distRecord.last > (int)m_config.cells_per_frame) distRecord.last = m_config.cells_per_frame;
+
+            // If no 'step' is specified, we're defining every cell from 'first' to 'last'
+            if (distRecord.step == 0) distRecord.step = 1;
+
+            // Clear the list of fragments in this record
+            distRecord.segment.clear();
+            distRecord.length = 0;
+
+            // Point to the comma separated fragement ids that come after the '$' delimeter.  Just
+            // in case the user added a comma after the '$', consume it 
+            CCsvScanner tail(delimeter + 1, lineEnd);
+            tail.skipWhitespace();
+            if (tail.position() < lineEnd && *tail.position() == ',') tail = CCsvScanner(tail.position() + 1, lineEnd);
+
+            // Loop through every fragment name in the comma separated list...
+            while (tail.nextToken(fragmentName))
+            {
+                // A fragment name can be followed by "*N", which means that fragment N times over
+                int64_t count = 1;
+                auto it = m_inputs->fragmentId.find(fragmentName);
+                size_t star = fragmentName.rfind('*');
+                if (it == m_inputs->fragmentId.end() && star != string_view::npos)
+                {
+                    if (!parseNumber(fragmentName.substr(star + 1), count) || count < 1 || count > UINT32_MAX)
+                    {
+                        out.error = "Invalid repeat count in '" + string(fragmentName) + "'";
+                        return;
+                    }
+                    fragmentName = fragmentName.substr(0, star);
+                    it = m_inputs->fragmentId.find(fragmentName);
+                }
+
+                // If we don't recognize this fragment name, complain
+                if (it == m_inputs->fragmentId.end())
+                {
+                    out.error = "Undefined fragment name '" + string(fragmentName) + "'";
+                    return;
+                }
+
+                // Get a reference to this fragment
+                const fragment_t& frag = m_inputs->fragmentTable[it->second];
+
+                // An empty fragment contributes nothing to the sequence
+                if (frag.length == 0) continue;
+
+                // Positions within a sequence are 32-bit
+                uint64_t length = distRecord.length + frag.length * count;
+                if (length > UINT32_MAX)
+                {
+                    out.error = "The fragment sequence for cell " + to_string(distRecord.first) + " is too long";
+                    return;
+                }
+
+                // Append this fragment's pieces to the distribution record.  The values of a piece
+                // already repeat, so a fragment with only one piece is repeated by lengthening it
+                if (frag.pieceCount == 1)
+                {
+                    segment_t seg = frag.head;
+                    seg.end = length;
+                    distRecord.segment.push_back(seg);
+                }
+                else if (count == 1)
+                {
+                    const segment_t* pieces = &m_inputs->fragmentPieces[frag.firstPiece];
+                    for (uint32_t i=0; i<frag.pieceCount; ++i)
+                    {
+                        segment_t seg = pieces[i];
+                        seg.end = distRecord.length + pieces[i].end;
+                        distRecord.segment.push_back(seg);
+                    }
+                }
+
+                // A repeated fragment with several pieces is looked up in the piece table
+                else
+                {
+                    distRecord.segment.push_back
+                    (
+                        {frag.firstPiece, (uint32_t)length, frag.length, SEGMENT_FRAGMENT, frag.pieceCount}
+                    );
+                }
+
+                distRecord.length = length;
+            }
+
+            // And add this distribution record to the list
+            out.record.push_back(distRecord);
+        }
+    };
+
+    // Parse the pieces, in parallel if there's more than one
+    vector<thread> worker;
+    for (size_t i=1; i<piece.size(); ++i) worker.emplace_back(parse, i);
+    parse(0);
+    for (auto& t : worker) t.join();
+
+    // Add the records from each piece to the distribution list, in the order they appear in the
+    // file.  If a piece has an error, the records after it don't matter
+    for (auto& pc : piece)
+    {
+        m_inputs->distributionList.insert(m_inputs->distributionList.end(), pc.record.begin(), pc.record.end());
+        if (!pc.error.empty()) throwRuntime("%s", pc.error.c_str());
+    }
+
+    // Build the index that lets frame-builders skip records that have run out of data
+    buildActiveIndex();
+
+    // Find out which record owns each cell
+    resolveCellOwnership();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// longestSequence() - Finds and returns the number of frames required by the longest sequence
+//                     in the distribution list
+//==========================================================================================================
+uint32_t CFrameGenerator::longestSequence() const
+{
+    uint32_t longestLength = 0;
+
+    // Loop through every record in the distribution list and keep
+    // track of the length of the longest sequence of fragments we find    
+    for (auto& distRec : m_inputs->distributionList)
+    {
+        // Keep track of the length of the longest sequence of fragments we find
+        if (distRec.length > longestLength) longestLength = distRec.length;
+    };
+
+    // Hand the caller the length of the longest sequence of fragments
+    return longestLength;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// buildActiveIndex() - Builds the sorted list of sequence lengths that tells a frameBuilder_t when
+//                      records in its live list run out of data
+//==========================================================================================================
+void CFrameGenerator::buildActiveIndex()
+{
+    vector<uint32_t>& ends = m_inputs->sequenceEnds;
+    ends.clear();
+
+    // Collect the length of every fragment sequence
+    for (auto& dr : m_inputs->distributionList) ends.push_back(dr.length);
+
+    // Sort them and throw away the duplicates
+    sort(ends.begin(), ends.end());
+    ends.erase(unique(ends.begin(), ends.end()), ends.end());
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// pieceValue() - Returns the value at position 'offset' of a segment that isn't a SEGMENT_FRAGMENT
+//==========================================================================================================
+static inline uint8_t pieceValue(const segment_t& piece, uint32_t offset, const uint8_t* arena)
+{
+    if (offset >= piece.period) offset %= piece.period;
+    if (piece.kind == SEGMENT_VALUES) return arena[piece.origin + offset];
+    return piece.origin + piece.step * offset;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// sequenceValue() - Returns the value at position 'frameNumber' in a distribution record's
+//                   sequence of fragments
+//
+// Passed: dr          = The distribution record.  'frameNumber' must be less than dr.length
+//         frameNumber = The position within the sequence
+//         cursor      = The segment that the previous lookup for this record found its value in
+//
+// Frames are almost always built in ascending order, so the value is nearly always in the same
+// segment as last time or in the one after it.  If it isn't, the segment is found by a binary
+// search of the segment end positions
+//==========================================================================================================
+uint8_t CFrameGenerator::sequenceValue(const distribution_t& dr, uint32_t frameNumber, uint32_t& cursor) const
+{
+    auto& seg = dr.segment;
+    auto isBefore = [](uint32_t f, const segment_t& s) {return f < s.end;};
+
+    // Find the segment that contains this frame number, starting with the one we found last time
+    if (cursor >= seg.size() || frameNumber >= seg[cursor].end || (cursor && frameNumber < seg[cursor-1].end))
+    {
+        if (cursor + 1 < seg.size() && frameNumber >= seg[cursor].end && frameNumber < seg[cursor+1].end)
+            ++cursor;
+        else
+            cursor = upper_bound(seg.begin(), seg.end(), frameNumber, isBefore) - seg.begin();
+    }
+
+    // Where in the sequence does that segment begin?
+    uint32_t begin = cursor ? seg[cursor-1].end : 0;
+
+    // Most segments store or compute their values directly
+    const segment_t& segment = seg[cursor];
+    const uint8_t*   arena   = m_inputs->fragmentArena.data();
+    uint32_t         offset  = frameNumber - begin;
+    if (segment.kind != SEGMENT_FRAGMENT) return pieceValue(segment, offset, arena);
+
+    // A repeated fragment of several pieces.  Find the piece of the fragment that the value is in
+    offset %= segment.period;
+    const segment_t* first = &m_inputs->fragmentPieces[segment.origin];
+    const segment_t* piece = upper_bound(first, first + segment.step, offset, isBefore);
+    return pieceValue(*piece, offset - (piece == first ? 0 : piece[-1].end), arena);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// updateLiveRecords() - Brings the list of live distribution records up to date for the 
+//                       specified frame number
+//
+// Frames are usually built in ascending order, so the list normally only needs to have expired
+// records weeded out of it (which happens just once per distinct sequence length).  If a frame 
+// earlier than the last one is requested, the list is rebuilt from scratch.  Records stay in the
+// order they appear in the distribution file so that overlapping records resolve as they always
+// have: the last one wins.
+//
+// The cells owned by a record that runs out of data simply go back to being quiescent, unless the
+// record was contested, in which case some other live record may now own them.  Those records are
+// noted in fb.expired, for updateOwnedCells()
+//==========================================================================================================
+void CFrameGenerator::updateLiveRecords(frameBuilder_t& fb, uint32_t frameNumber) const
+{
+    // If we have to start from scratch, find every record that has data for this frame
+    if (!fb.valid || frameNumber < fb.liveFrame)
+    {
+        fb.live.clear();
+        for (uint32_t i=0; i<m_inputs->distributionList.size(); ++i)
+        {
+            if (frameNumber < m_inputs->distributionList[i].length) fb.live.push_back(i);
+        }
+        fb.cursor.assign(m_inputs->distributionList.size(), 0);
+        fb.valid          = true;
+        fb.ownershipValid = false;
+        fb.expired.clear();
+    }
+
+    // Otherwise, if some records may have run out of data, weed them out
+    else if (frameNumber >= fb.liveExpiry)
+    {
+        auto expired = [&](uint32_t i) {return frameNumber >= m_inputs->distributionList[i].length;};
+        auto isGone  = [&](const ownedCells_t& oc) {return expired(oc.record);};
+        for (uint32_t i : fb.live) if (expired(i) && m_inputs->distributionList[i].contested) fb.expired.push_back(i);
+        fb.live.erase(remove_if(fb.live.begin(), fb.live.end(), expired), fb.live.end());
+        fb.owned.erase(remove_if(fb.owned.begin(), fb.owned.end(), isGone), fb.owned.end());
+    }
+
+    // Find the next frame number at which a record runs out of data
+    auto it = upper_bound(m_inputs->sequenceEnds.begin(), m_inputs->sequenceEnds.end(), frameNumber);
+    fb.liveExpiry = (it == m_inputs->sequenceEnds.end()) ? UINT32_MAX : *it;
+    fb.liveFrame  = frameNumber;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// resolveCellOwnership() - Works out, once and for all, which distribution record owns each cell while
+//                          every record has data.  Where records overlap, the last one in the
+//                          distribution list owns the cell, and the records it overrides are noted
+//
+// On Exit: m_inputs->cellOwner, m_inputs->overlaps, and the 'contested' flag of every record are valid
+//
+// Records with no data at all never populate anything, so they're ignored
+//==========================================================================================================
+void CFrameGenerator::resolveCellOwnership()
+{
+    auto& list  = m_inputs->distributionList;
+    auto& owner = m_inputs->cellOwner;
+    uint32_t cells = m_config.cells_per_frame;
+
+    // For every cell, count how many records populate it (saturating at 2), and let the last
+    // record that populates it own it
+    vector<uint8_t> coverage(cells, 0);
+    owner.assign(cells, NO_OWNER);
+    for (uint32_t i=0; i<list.size(); ++i)
+    {
+        auto& dr = list[i];
+        if (dr.length == 0) continue;
+        for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+        {
+            if (coverage[cellNumber] < 2) ++coverage[cellNumber];
+            owner[cellNumber] = i;
+        }
+    }
+
+    // Make a list of the records that populate each cell, in distribution-list order
+    auto& start    = m_inputs->coverStart;
+    auto& coverers = m_inputs->coverers;
+    start.assign(cells + 1, 0);
+    for (auto& dr : list) if (dr.length)
+    {
+        for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+        {
+            ++start[cellNumber + 1];
+        }
+    }
+    for (uint32_t c=0; c<cells; ++c) start[c+1] += start[c];
+    coverers.resize(start[cells]);
+    vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for (uint32_t i=0; i<list.size(); ++i) if (list[i].length)
+    {
+        auto& dr = list[i];
+        for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+        {
+            coverers[fill[cellNumber]++] = i;
+        }
+    }
+
+    // A record is contested if any of its cells are populated more than once, and it loses
+    // whichever of those cells a later record owns
+    m_inputs->overlaps.clear();
+    m_inputs->firstHandover = UINT32_MAX;
+    for (uint32_t i=0; i<list.size(); ++i)
+    {
+        auto& dr = list[i];
+        overlap_t overlap = {i, 0, 0, 0};
+        dr.contested = false;
+        if (dr.length == 0) continue;
+        for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+        {
+            ++overlap.cells;
+            if (coverage[cellNumber] > 1) dr.contested = true;
+            if (owner[cellNumber] != i && overlap.overridden++ == 0) overlap.overriddenBy = owner[cellNumber];
+        }
+        if (overlap.overridden) m_inputs->overlaps.push_back(overlap);
+        if (dr.contested) m_inputs->firstHandover = min(m_inputs->firstHandover, dr.length);
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// updateOwnedCells() - Brings the frame-builder's list of the cells that each live record owns up to date
+//                      with its list of live records
+//
+// Returns: The index in fb.owned of the first entry whose cells have just changed hands (which is
+//          fb.owned.size() if none have)
+//==========================================================================================================
+template <bool LVDS>
+size_t CFrameGenerator::updateOwnedCells(frameBuilder_t& fb) const
+{
+    // If the list has to be built from scratch, every entry in it is new
+    if (!fb.ownershipValid || fb.ownershipLvds != LVDS)
+    {
+        resolveOwnedCells<LVDS>(fb);
+        return 0;
+    }
+
+    // If contested records have run out of data, some of their cells may now belong to other records
+    size_t firstNew = fb.owned.size();
+    if (!fb.expired.empty()) handOverCells<LVDS>(fb);
+    return firstNew;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// resolveOwnedCells() - Rebuilds the frame-builder's list of the cells that each live record owns, as
+//                       spans of equally spaced positions in the frame.  A record whose cells are
+//                       consecutive in the frame gets a single span with a stride of 1
+//
+// Until a contested record runs out of data, ownership is exactly as resolveCellOwnership() found
+// it.  After that, the live records are laid down in order to find out who owns what now
+//==========================================================================================================
+template <bool LVDS>
+void CFrameGenerator::resolveOwnedCells(frameBuilder_t& fb) const
+{
+    auto&    list  = m_inputs->distributionList;
+    uint32_t cells = m_config.cells_per_frame;
+
+    // Find out who owns each cell.  The last live record that populates a cell wins
+    if (fb.liveFrame < m_inputs->firstHandover)
+        fb.owner = m_inputs->cellOwner;
+    else
+    {
+        fb.owner.assign(cells, NO_OWNER);
+        for (uint32_t index : fb.live)
+        {
+            auto& dr = list[index];
+            for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+            {
+                fb.owner[cellNumber] = index;
+            }
+        }
+    }
+
+    // Gather the cells that each live record owns into spans
+    vector<pair<uint32_t, uint32_t>> owned;
+    fb.spans.clear();
+    fb.owned.clear();
+    for (uint32_t index : fb.live)
+    {
+        auto& dr = list[index];
+        for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+        {
+            if (fb.owner[cellNumber] == index) owned.push_back({index, cellPosition<LVDS>(cellNumber)});
+        }
+    }
+    appendOwnedCells(fb, owned);
+
+    fb.expired.clear();
+    fb.ownershipValid = true;
+    fb.ownershipLvds  = LVDS;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// handOverCells() - Gives each cell that a record in fb.expired owned to the last record that populates
+//                   it and still has data, if there is one
+//==========================================================================================================
+template <bool LVDS>
+void CFrameGenerator::handOverCells(frameBuilder_t& fb) const
+{
+    auto&    list  = m_inputs->distributionList;
+    vector<pair<uint32_t, uint32_t>> handed;
+
+    for (uint32_t index : fb.expired)
+    {
+        auto& dr = list[index];
+        for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+        {
+            if (fb.owner[cellNumber] != index) continue;
+
+            // Look for the last record that populates this cell and still has data
+            uint32_t newOwner = NO_OWNER;
+            for (uint32_t i = m_inputs->coverStart[cellNumber + 1]; i > m_inputs->coverStart[cellNumber];)
+            {
+                uint32_t candidate = m_inputs->coverers[--i];
+                if (list[candidate].length > fb.liveFrame) {newOwner = candidate; break;}
+            }
+
+            fb.owner[cellNumber] = newOwner;
+            if (newOwner != NO_OWNER) handed.push_back({newOwner, cellPosition<LVDS>(cellNumber)});
+        }
+    }
+    fb.expired.clear();
+
+    // Group the cells that changed hands by their new owner
+    stable_sort(handed.begin(), handed.end(), [](auto& a, auto& b) {return a.first < b.first;});
+    appendOwnedCells(fb, handed);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// appendOwnedCells() - Merges a list of (record, position) pairs into spans, and adds an entry to
+//                      fb.owned for each record.   The pairs of each record must be adjacent
+//==========================================================================================================
+void CFrameGenerator::appendOwnedCells(frameBuilder_t& fb, const vector<pair<uint32_t, uint32_t>>& cells) const
+{
+    for (size_t i=0; i<cells.size();)
+    {
+        uint32_t record    = cells[i].first;
+        uint32_t firstSpan = fb.spans.size();
+
+        for (; i < cells.size() && cells[i].first == record; ++i)
+        {
+            uint32_t position = cells[i].second;
+
+            // If this cell continues the record's most recent span, extend the span
+            if (fb.spans.size() > firstSpan)
+            {
+                cellSpan_t& span = fb.spans.back();
+                if (span.count == 1)
+                {
+                    span.stride = (int32_t)(position - span.start);
+                    span.count  = 2;
+                    continue;
+                }
+                if ((int64_t)span.start + (int64_t)span.count * span.stride == position)
+                {
+                    ++span.count;
+                    continue;
+                }
+            }
+
+            // Otherwise, start a new span
+            fb.spans.push_back({position, 1, 1});
+        }
+
+        fb.owned.push_back({record, firstSpan, (uint32_t)fb.spans.size()});
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// fillOwnedCells() - Stores a value in every cell of a record's spans
+//==========================================================================================================
+static inline void fillOwnedCells(uint8_t* frame, const frameBuilder_t& fb, const ownedCells_t& oc, uint8_t value)
+{
+    for (uint32_t i = oc.firstSpan; i < oc.endSpan; ++i)
+    {
+        const cellSpan_t& span = fb.spans[i];
+        if (span.stride == 1)
+            memset(frame + span.start, value, span.count);
+        else
+        {
+            uint8_t* p = frame + span.start;
+            for (uint32_t n = span.count; n; --n, p += span.stride) *p = value;
+        }
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// buildDataFrame() - Uses the fragment-sequence distribution list to create a data frame
+//
+// The frame is built in LVDS order if m_lvdsFused is true and in raw order otherwise.  Returns a
+// pointer to the frame, which is 'frame' itself except in delta mode, where the frame is kept
+// in fb.deltaFrame (and 'frame' is untouched)
+//==========================================================================================================
+const uint8_t* CFrameGenerator::buildDataFrame(frameBuilder_t& fb, uint8_t* frame, uint32_t frameNumber) const
+{
+    // In delta mode, the frame is derived from the previous one
+    if (m_options.delta)
+    {
+        if (m_lvdsFused)
+            updateDeltaFrame<true>(fb, frameNumber);
+        else
+            updateDeltaFrame<false>(fb, frameNumber);
+        return fb.deltaFrame.data();
+    }
+
+    // Otherwise, build the frame from scratch
+    if (m_lvdsFused)
+        buildFullDataFrame<true>(fb, frame, frameNumber);
+    else
+        buildFullDataFrame<false>(fb, frame, frameNumber);
+    return frame;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// buildFullDataFrame() - Builds a data frame from scratch.  Each cell is stored at the position
+//                        given by cellPosition<LVDS>().  Every cell is written exactly once: by the
+//                        record that owns it, or with the quiescent value if nothing owns it
+//==========================================================================================================
+template <bool LVDS> 
+void CFrameGenerator::buildFullDataFrame(frameBuilder_t& fb, uint8_t* frame, uint32_t frameNumber) const
+{
+    // Every cell in the frame starts out quiescient
+    memset(frame, m_config.quiescent, m_config.cells_per_frame);
+
+    // Find out which distribution records have data for this frame, and which cells they own
+    updateLiveRecords(fb, frameNumber);
+    updateOwnedCells<LVDS>(fb);
+
+    // Loop through every distribution record that has a value for this frame number
+    for (auto& oc : fb.owned)
+    {
+        auto& dr = m_inputs->distributionList[oc.record];
+
+        // Populate the cells it owns with the data value for this frame
+        fillOwnedCells(frame, fb, oc, sequenceValue(dr, frameNumber, fb.cursor[oc.record]));
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// updateDeltaFrame() - Brings fb.deltaFrame up to date for the specified frame number
+//
+// If fb.deltaFrame holds the frame just before this one, only the cells that differ are written:
+//   (1) Cells owned by records whose sequence has just run out go back to quiescent
+//   (2) Cells that have just changed hands are rewritten with their new owner's value
+//   (3) Cells owned by records whose value changed since the previous frame are rewritten
+//
+// Otherwise, fb.deltaFrame is built from scratch
+//==========================================================================================================
+template <bool LVDS> 
+void CFrameGenerator::updateDeltaFrame(frameBuilder_t& fb, uint32_t frameNumber) const
+{
+    // The first time through, allocate the frame
+    if (fb.deltaFrame.empty()) fb.deltaFrame.resize(m_config.cells_per_frame);
+
+    // Get a pointer to the frame
+    uint8_t* frame = fb.deltaFrame.data();
+
+    // If we don't have the previous frame on hand, build this one from scratch
+    if (frameNumber == 0 || fb.deltaFrameNumber != (int64_t)frameNumber - 1)
+    {
+        buildFullDataFrame<LVDS>(fb, frame, frameNumber);
+        fb.deltaFrameNumber = frameNumber;
+        fb.deltaChanged     = true;
+        return;
+    }
+
+    // We'll find out whether anything differs from the previous frame
+    fb.deltaChanged = false;
+
+    // If some live records may have run out of data, return the cells they own to quiescent
+    if (frameNumber >= fb.liveExpiry) for (auto& oc : fb.owned)
+    {
+        if (frameNumber < m_inputs->distributionList[oc.record].length) continue;
+        fb.deltaChanged = true;
+        fillOwnedCells(frame, fb, oc, m_config.quiescent);
+    }
+
+    // Find out which distribution records have data for this frame, and which cells they own
+    updateLiveRecords(fb, frameNumber);
+    size_t firstNew = updateOwnedCells<LVDS>(fb);
+    if (firstNew < fb.owned.size()) fb.deltaChanged = true;
+
+    // Rewrite the cells that have just changed hands, and those of every live record whose value
+    // has changed
+    for (size_t i=0; i<fb.owned.size(); ++i)
+    {
+        auto& oc = fb.owned[i];
+        auto& dr = m_inputs->distributionList[oc.record];
+
+        // Fetch the values for the previous frame and this one
+        uint8_t prior = sequenceValue(dr, frameNumber-1, fb.cursor[oc.record]);
+        uint8_t value = sequenceValue(dr, frameNumber,   fb.cursor[oc.record]);
+
+        // If it's the same as the previous frame, the cells are already correct
+        if (value == prior && i < firstNew) continue;
+        fb.deltaChanged = true;
+
+        // Populate the cells it owns with the data value for this frame
+        fillOwnedCells(frame, fb, oc, value);
+    }
+
+    // fb.deltaFrame now holds this frame
+    fb.deltaFrameNumber = frameNumber;
+}
+//==========================================================================================================
+
+// The specializations that other modules (such as the benchmarks) use
+template void CFrameGenerator::buildFullDataFrame<true >(frameBuilder_t&, uint8_t*, uint32_t) const;
+template void CFrameGenerator::buildFullDataFrame<false>(frameBuilder_t&, uint8_t*, uint32_t) const;
+template void CFrameGenerator::updateDeltaFrame<true >(frameBuilder_t&, uint32_t) const;
+template void CFrameGenerator::updateDeltaFrame<false>(frameBuilder_t&, uint32_t) const;
+
+
+//==========================================================================================================
+// isUniformFrame() - Returns true if every cell of the specified frame holds the same value
+//==========================================================================================================
+bool CFrameGenerator::isUniformFrame(uint64_t frameIndex) const
+{
+    uint32_t diagnosticFrames = m_config.diagnostic_values.size();
+    uint64_t frameGroup       = frameIndex / frameGroupLength();
+    uint32_t groupOffset      = frameIndex % frameGroupLength();
+
+    // Diagnostic frames are uniform, and so are data frames once every sequence has ended
+    if (groupOffset < diagnosticFrames) return true;
+    return isQuiescentFrame(frameGroup * m_config.data_frames + (groupOffset - diagnosticFrames));
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// buildFrame() - Builds the final (i.e., LVDS re-ordered) contents of any frame in the output
+//                file, diagnostic or data
+//
+// Passed: fb         = The calling thread's frame-builder state
+//         frame      = Pointer to where the frame should be built
+//         frameIndex = The index of the frame within the output file
+//
+// The contents of a frame are a function of nothing but its index, which is what allows frames
+// to be built in any order and on any thread
+//==========================================================================================================
+void CFrameGenerator::buildFrame(frameBuilder_t& fb, uint8_t* frame, uint64_t frameIndex) const
+{
+    // How many diagnostic frames are there?
+    uint32_t diagnosticFrames = m_config.diagnostic_values.size();
+
+    // A "frame group" is a set of diagnostic frames followed by a set of data frames.
+    uint32_t frameGroupLength = diagnosticFrames + m_config.data_frames;
+
+    // Which frame group is this frame in, and where within that frame group is it?
+    uint64_t frameGroup  = frameIndex / frameGroupLength;
+    uint32_t groupOffset = frameIndex % frameGroupLength;
+
+    // If this is a diagnostic frame, every cell contains the same diagnostic value
+    if (groupOffset < diagnosticFrames)
+    {
+        memset(frame, m_config.diagnostic_values[groupOffset], m_config.cells_per_frame);
+        return;
+    }
+
+    // Determine the data frame number of this frame
+    uint32_t frameNumber = frameGroup * m_config.data_frames + (groupOffset - diagnosticFrames);
+
+    // Once every fragment sequence has ended, data frames are entirely quiescent
+    if (isQuiescentFrame(frameNumber))
+    {
+        memset(frame, m_config.quiescent, m_config.cells_per_frame);
+        return;
+    }
+
+    // Build the data frame for this frame number
+    const uint8_t* built = buildDataFrame(fb, frame, frameNumber);
+
+    // If the frame was built in raw order, translate it into LVDS order
+    if (m_lvdsReorderPass)
+    {
+        if (built == frame)
+            reorderForLvds(frame);
+        else
+            reorderForLvds(built, frame);
+    }
+
+    // In delta mode, the frame was built outside of 'frame' and has to be copied into it
+    else if (built != frame) memcpy(frame, built, m_config.cells_per_frame);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// reorderForLvds() - Translates a frame of data into the order in which the ECD's LVDS logic
+//                    needs to transmit it to the FPGA
+//
+// Think of a row of cell data as existing in a "raw" order (i.e., the order that we think of it
+// logically being in), and an "lvds order", which is the order it has to be in so that the ECD
+// can transmit it to the FPGA over LVDS.
+//
+// The value 'x' at some given index 'i' in the translation table means:
+//    At location 'i' in the lvds-ordered row, you will find the value from location 'x' in the
+//    raw-ordered row.  Stated another way: lvds_order[i] = raw_order[x]
+//
+//==========================================================================================================
+void CFrameGenerator::reorderForLvds(uint8_t* rawFrame) const
+{
+    uint8_t lvdsRow[ROW_SIZE];
+
+    // How many rows are in a frame of data?
+    int rowsPerFrame = m_config.cells_per_frame / ROW_SIZE;
+
+    // Loop through each row of data in the frame...
+    for (int row=0; row<rowsPerFrame; ++row)
+    {
+        // Create a pointer to this row of data within the frame
+        uint8_t* rawRow  = rawFrame + ROW_SIZE * row;
+    
+        // Translate this row of data from raw order to LVDS order
+        m_lvdsKernel(rawRow, lvdsRow);
+
+        // Copy the lvds-ordered data back into the original frame
+        memcpy(rawRow, lvdsRow, ROW_SIZE);
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// reorderForLvds() - Same as above, but translates the raw frame into a separate LVDS frame 
+//                    rather than in place
+//==========================================================================================================
+void CFrameGenerator::reorderForLvds(const uint8_t* rawFrame, uint8_t* lvdsFrame) const
+{
+    // How many rows are in a frame of data?
+    int rowsPerFrame = m_config.cells_per_frame / ROW_SIZE;
+
+    // Translate each row of data from raw order to LVDS order
+    for (int row=0; row<rowsPerFrame; ++row)
+    {
+        m_lvdsKernel(rawFrame + ROW_SIZE * row, lvdsFrame + ROW_SIZE * row);
+    }
+}
+//==========================================================================================================
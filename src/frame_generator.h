@@ -0,0 +1,474 @@
+//==========================================================================================================
+// frame_generator.h - Defines CFrameGenerator, which builds the frames of an ECD sample image from the
+//                     fragment and distribution definition files
+//
+// This is the library that "esp" is built on.   A program that wants frames in memory (for instance,
+// straight into its own DMA buffers) can use it directly instead of running esp and reading the file:
+//
+//     config_t config;
+//     readConfigurationFile("ecd_sample_prep.conf", config);
+//     CFrameGenerator generator(config);
+//     generator.load();
+//     generator.fill(firstFrame, frameCount, buffer);
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include "lvds_reorder.h"
+
+
+//----------------------------------------------------------------------------------------------------------
+// config_t - The settings from the configuration file.  Variable names in this structure should exactly
+//            match the configuration file
+//----------------------------------------------------------------------------------------------------------
+struct config_t
+{
+    uint32_t                cells_per_frame;
+    uint64_t                contig_size;
+    std::vector<uint8_t>    diagnostic_values;
+    uint32_t                data_frames;
+    uint8_t                 quiescent;
+    std::string             fragment_file;
+    std::string             distribution_file;
+    std::string             output_file;
+    std::string             output_mode;
+    std::string             output_format;
+    uint64_t                write_buffer_size;
+    uint32_t                uring_queue_depth;
+    std::string             contig_device;
+    uint64_t                contig_offset;
+    std::string             cache_file;
+    double                  progress_interval;
+    uint64_t                frame_cache_size;
+    bool                    checksums;
+    int32_t                 compression_level;
+};
+
+// Reads a configuration file into 'config'.  If 'filename' is empty, "ecd_sample_prep.conf" is read.
+// Can throw exception runtime_error
+void readConfigurationFile(std::string filename, config_t& config);
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// generatorOptions_t - The choices about how frames are built that aren't in the configuration file
+//----------------------------------------------------------------------------------------------------------
+struct generatorOptions_t
+{
+    // If false, cells are left in raw order rather than being re-ordered for LVDS transmission
+    bool        lvds = true;
+
+    // If true, each data frame is built by applying only the changes from the previous frame
+    bool        delta = false;
+
+    // "fused" builds frames directly in LVDS order.  Anything else is the name of a kernel for
+    // selectLvdsKernel(), which re-orders each frame after it's built in raw order
+    std::string lvdsKernel = "fused";
+
+    // The number of threads that large input files are parsed on
+    uint32_t    threads = 1;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// The compiled form of the input files
+//----------------------------------------------------------------------------------------------------------
+
+// The ways that a segment (or a piece of a fragment) can produce its values
+enum segmentKind_t
+{
+    SEGMENT_VALUES,     // Values stored in the fragment arena
+    SEGMENT_RAMP,       // origin, origin + step, origin + 2*step, ...  (a repeated value is a ramp with step 0)
+    SEGMENT_FRAGMENT    // The values of a fragment that is made of more than one piece
+};
+
+// One piece of a fragment, or one fragment within a distribution record's sequence of fragments.
+// The values repeat every 'period' positions, so a long repetitive run costs no more memory than a
+// single copy of it
+struct segment_t
+{
+    // SEGMENT_VALUES   : where the values start in the fragment arena
+    // SEGMENT_RAMP     : the first value of the ramp
+    // SEGMENT_FRAGMENT : the index of the fragment's first piece in the piece table
+    uint32_t        origin;
+
+    // The position just past the end of this segment (i.e., the sum of the lengths of this segment
+    // and every segment before it in the sequence or fragment)
+    uint32_t        end;
+
+    // The number of positions after which the values start over
+    uint32_t        period;
+
+    // A segmentKind_t, and for SEGMENT_RAMP the difference between consecutive values (only the low
+    // 8 bits of a value matter, so it's kept modulo 256).  For SEGMENT_FRAGMENT, 'step' is the number
+    // of pieces the fragment is made of
+    uint32_t        kind : 2, step : 30;
+};
+
+// A fragment definition.  A fragment's ID is its index in the fragment table.  Its pieces are
+// pieceCount consecutive entries in the piece table, starting at firstPiece
+struct fragment_t
+{
+    uint32_t        firstPiece, pieceCount, length;
+
+    // A copy of the first piece, so that a fragment with only one piece (which most are) can be
+    // used without visiting the piece table
+    segment_t       head;
+};
+
+// A record from the distribution definitions file
+struct distribution_t
+{
+    int             first = 0, last = 0, step = 0;
+
+    // The record's sequence of fragments, and the total number of values in that sequence
+    std::vector<segment_t> segment;
+    uint32_t        length = 0;
+
+    // True if some other record in the distribution list populates any of the same cells
+    bool            contested = false;
+};
+
+// A distribution record that populates cells which a later record also populates.  While both
+// records have data, the later one wins those cells
+struct overlap_t
+{
+    // The record's index in the distribution list, and the number of cells it populates
+    uint32_t        record, cells;
+
+    // How many of those cells a later record populates, and the index of one such record
+    uint32_t        overridden, overriddenBy;
+};
+
+// A run of cells, all owned by the same distribution record, that are equally spaced in the frame.
+// 'start' is the position of the first of them, and 'stride' is the distance from one to the next
+struct cellSpan_t
+{
+    uint32_t        start;
+    int32_t         stride;
+    uint32_t        count;
+};
+
+// The cells that one live distribution record owns: spans [firstSpan, endSpan) of frameBuilder_t::spans
+struct ownedCells_t
+{
+    uint32_t        record, firstSpan, endSpan;
+};
+
+// The header of a compiled-distribution file.  It's followed by the fragment arena (padded to a
+// multiple of 8 bytes), then the piece table, then a cacheRecord_t for each distribution record,
+// then the segments of every record, one record after another.
+//
+// Compiled distributions are used both as the cache of the input files, and as the record (kept
+// alongside the output file) of the distribution that the output file was built from
+struct cacheHeader_t
+{
+    char     magic[8];
+    uint32_t cellsPerFrame;
+    uint32_t reserved;
+    uint64_t inputHash;
+    uint64_t layoutHash;
+    uint64_t arenaSize, pieceCount, recordCount, segmentCount;
+};
+
+struct cacheRecord_t
+{
+    int32_t  first, last, step;
+    uint32_t length, segmentCount, contested;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// compiledInputs_t - Everything that's loaded from the fragment and distribution definitions.  None of it
+//                    depends on how the image is laid out, so generators with different layouts can share it
+//----------------------------------------------------------------------------------------------------------
+struct compiledInputs_t
+{
+    // The stored values of every fragment, one fragment after another
+    std::vector<uint8_t>    fragmentArena;
+
+    // The pieces that fragments are made of, one fragment after another
+    std::vector<segment_t>  fragmentPieces;
+
+    // The fragment definitions, indexed by fragment ID
+    std::vector<fragment_t> fragmentTable;
+
+    // Maps each fragment name to its ID.  The names themselves are interned in fragmentNames
+    std::deque<std::string> fragmentNames;
+    std::unordered_map<std::string_view, uint32_t> fragmentId;
+
+    // Each record in the distribution definitions file
+    std::vector<distribution_t> distributionList;
+
+    // The distinct lengths of the fragment sequences, in ascending order.  These are the frame
+    // numbers at which records in the distribution list run out of data
+    std::vector<uint32_t>   sequenceEnds;
+
+    // For each cell, the index of the record that owns it while every record has data (i.e., the
+    // last record in the distribution list that populates it), or NO_OWNER
+    std::vector<uint32_t>   cellOwner;
+
+    // The records that populate each cell, in distribution-list order: those of cell 'c' are
+    // coverers[coverStart[c]] thru coverers[coverStart[c+1] - 1]
+    std::vector<uint32_t>   coverStart, coverers;
+
+    // The shortest sequence of any contested record.  Until then, cellOwner is exactly right
+    uint32_t                firstHandover;
+
+    // The records that lose cells to later records, in distribution-list order
+    std::vector<overlap_t>  overlaps;
+};
+
+// The value of compiledInputs_t::cellOwner for cells that no record populates
+const uint32_t NO_OWNER = UINT32_MAX;
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// frameBuilder_t - Each thread that builds data frames keeps one of these.  It tracks which distribution
+//                  records still have data for the frame being built, so that records whose fragment
+//                  sequence has run out don't have to be visited
+//----------------------------------------------------------------------------------------------------------
+struct frameBuilder_t
+{
+    // Indices of the "live" records in the distribution list, in distribution-file order
+    std::vector<uint32_t> live;
+
+    // The frame number that 'live' is valid for, and the frame number where the next record in
+    // 'live' might run out of data
+    uint32_t         liveFrame, liveExpiry;
+
+    // This is false until 'live' has been populated the first time
+    bool             valid = false;
+
+    // For each record in the distribution list, the index of the segment that sequenceValue()
+    // last found a value in
+    std::vector<uint32_t> cursor;
+
+    // The cells that the live records own.  A record can have more than one entry in 'owned', since
+    // cells that change hands (when a contested record runs out of data) are added separately
+    std::vector<cellSpan_t>   spans;
+    std::vector<ownedCells_t> owned;
+
+    // The record that owns each cell at the moment, and the contested records that have run out of
+    // data since their cells were last handed over
+    std::vector<uint32_t>     owner;
+    std::vector<uint32_t>     expired;
+
+    // False if 'owned' has to be rebuilt from scratch, and whether its positions are in LVDS order
+    bool             ownershipValid = false, ownershipLvds = false;
+
+    // In "delta" mode, this is the most recently built data frame and its frame number
+    std::vector<uint8_t>  deltaFrame;
+    int64_t          deltaFrameNumber = -1;
+
+    // In "delta" mode, this is false if deltaFrame is identical to the frame before it
+    bool             deltaChanged;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CFrameGenerator - Compiles the fragment and distribution definitions, and builds any frame of the
+//                   resulting image on demand.
+//
+// The image is a series of frame groups, each of which is some diagnostic frames followed by some data
+// frames.  The contents of a frame are a function of nothing but its index, so frames can be built in
+// any order.  Once the definitions are loaded, the generator is never modified by building frames, so
+// any number of threads can call fill() (or use their own iterators) at the same time
+//----------------------------------------------------------------------------------------------------------
+class CFrameGenerator
+{
+public:
+
+    // Can throw exception runtime_error if the configuration or the options are invalid
+    CFrameGenerator(const config_t& config, const generatorOptions_t& options = generatorOptions_t());
+
+    // Shares the definitions that 'source' has already loaded rather than loading them again, and lays
+    // them out as 'config' says.  Frames must be the same size as those of 'source', and neither
+    // generator may load anything more once they're sharing.   Can throw exception runtime_error
+    CFrameGenerator(const config_t& config, const CFrameGenerator& source,
+                    const generatorOptions_t& options = generatorOptions_t());
+
+    // Call this to load the fragment and distribution definitions.  If the configuration names a
+    // cache_file that was compiled from the current input files, it's loaded instead, and otherwise
+    // the cache is rebuilt.   Can throw exception runtime_error
+    void        load();
+
+    // These are the steps that load() takes.  Each can throw exception runtime_error
+    void        loadFragments();
+    void        loadDistribution();
+    uint64_t    hashInputFiles() const;
+    bool        loadCompiledDistribution(uint64_t inputHash);
+    void        saveCompiledDistribution(uint64_t inputHash) const;
+
+    //------------------------------------------------------------------------------------------------------
+    // The shape of the image
+    //------------------------------------------------------------------------------------------------------
+
+    // The number of bytes in a frame
+    uint32_t    frameSize() const {return m_config.cells_per_frame;}
+
+    // The number of frames in a frame group
+    uint32_t    frameGroupLength() const {return m_config.diagnostic_values.size() + m_config.data_frames;}
+
+    // The number of frames in the longest fragment sequence
+    uint32_t    longestSequence() const;
+
+    // The number of frame groups needed to hold the longest fragment sequence
+    uint32_t    frameGroupCount() const {return longestSequence() / m_config.data_frames + 1;}
+
+    // The number of frames in the entire image
+    uint64_t    frameCount() const {return (uint64_t)frameGroupCount() * frameGroupLength();}
+
+    //------------------------------------------------------------------------------------------------------
+    // Fetching frames
+    //------------------------------------------------------------------------------------------------------
+
+    // Builds 'count' consecutive frames, starting with frame 'frameIndex', into 'dst', which must have
+    // room for count * frameSize() bytes
+    void        fill(uint64_t frameIndex, uint64_t count, uint8_t* dst) const;
+
+    // A forward iterator over the frames of the image.  Dereferencing it yields a pointer to the frame,
+    // which remains valid until the iterator is advanced
+    class iterator
+    {
+    public:
+        iterator(const CFrameGenerator* generator, uint64_t frameIndex);
+        const uint8_t*  operator*() const {return m_frame.data();}
+        iterator&       operator++() {++m_frameIndex; build(); return *this;}
+        bool            operator==(const iterator& other) const {return m_frameIndex == other.m_frameIndex;}
+        bool            operator!=(const iterator& other) const {return m_frameIndex != other.m_frameIndex;}
+        uint64_t        frameIndex() const {return m_frameIndex;}
+    protected:
+        void            build();
+        const CFrameGenerator* m_generator;
+        uint64_t               m_frameIndex;
+        frameBuilder_t         m_builder;
+        std::vector<uint8_t>   m_frame;
+    };
+
+    // These iterate over the frames in [frameIndex, frameCount())
+    iterator    begin(uint64_t frameIndex = 0) const {return iterator(this, frameIndex);}
+    iterator    end() const {return iterator(this, frameCount());}
+
+    //------------------------------------------------------------------------------------------------------
+    // The building blocks of a frame
+    //------------------------------------------------------------------------------------------------------
+
+    // Builds the final (i.e., LVDS re-ordered) contents of any frame, diagnostic or data
+    void        buildFrame(frameBuilder_t& fb, uint8_t* frame, uint64_t frameIndex) const;
+
+    // Builds a data frame, in LVDS order if lvdsFused() and in raw order otherwise.  Returns a pointer
+    // to the frame, which is 'frame' itself except in delta mode, where it's fb.deltaFrame
+    const uint8_t* buildDataFrame(frameBuilder_t& fb, uint8_t* frame, uint32_t frameNumber) const;
+
+    // Builds a data frame from scratch, storing each cell at cellPosition<LVDS>()
+    template <bool LVDS> void buildFullDataFrame(frameBuilder_t& fb, uint8_t* frame, uint32_t frameNumber) const;
+
+    // Brings fb.deltaFrame up to date for the specified frame number
+    template <bool LVDS> void updateDeltaFrame(frameBuilder_t& fb, uint32_t frameNumber) const;
+
+    // Returns true if a data frame is beyond the end of every fragment sequence
+    bool        isQuiescentFrame(uint32_t frameNumber) const
+                {return m_inputs->sequenceEnds.empty() || frameNumber >= m_inputs->sequenceEnds.back();}
+
+    // Returns true if every cell of a frame holds the same value (i.e., it's a diagnostic frame, or
+    // a data frame that's beyond the end of every fragment sequence)
+    bool        isUniformFrame(uint64_t frameIndex) const;
+
+    // Returns a frame in which every cell holds the quiescent value or one of the diagnostic values
+    const std::vector<uint8_t>& uniformFrame(uint8_t value) const {return m_uniformFrame[value];}
+
+    // True if data frames are built directly in LVDS order
+    bool        lvdsFused() const {return m_lvdsFused;}
+
+    // True if data frames are built in raw order and then translated by reorderForLvds()
+    bool        lvdsReorderPass() const {return m_lvdsReorderPass;}
+
+    // Translate a raw-ordered frame into LVDS order, either in place or into 'lvdsFrame'
+    void        reorderForLvds(uint8_t* frame) const;
+    void        reorderForLvds(const uint8_t* rawFrame, uint8_t* lvdsFrame) const;
+
+    //------------------------------------------------------------------------------------------------------
+    // The compiled distribution
+    //------------------------------------------------------------------------------------------------------
+
+    // The records of the distribution definitions file, in file order
+    const std::vector<distribution_t>& distributionList() const {return m_inputs->distributionList;}
+
+    // The records that lose some of their cells to later records
+    const std::vector<overlap_t>& overlaps() const {return m_inputs->overlaps;}
+
+    // Returns the value at position 'frameNumber' of a record's fragment sequence.  'cursor' is the
+    // segment that the previous lookup for this record found its value in
+    uint8_t     sequenceValue(const distribution_t& dr, uint32_t frameNumber, uint32_t& cursor) const;
+
+    // Returns a hash of everything other than the distribution that determines where data frames are
+    // in the image and where cells are within them
+    uint64_t    hashLayout() const;
+
+    // Reads a compiled-distribution file.  'accept' is handed the file's header and returns false if
+    // the file is of no use.  The file's fragment arena and piece table are appended to ours, and the
+    // records in 'list' refer to them.  Returns true if the file was read
+    bool        readCompiledDistribution(std::string filename, std::function<bool(const cacheHeader_t&)> accept,
+                                         std::vector<distribution_t>& list);
+
+    // Writes the compiled distribution to a file.  Returns true on success
+    bool        writeCompiledDistribution(std::string filename, uint64_t inputHash, uint64_t layoutHash) const;
+
+protected:
+
+    // Builds the list of sequence lengths that tells a frameBuilder_t when records run out of data
+    void        buildActiveIndex();
+
+    // Works out which record owns each cell, which records are contested, and which ones overlap
+    void        resolveCellOwnership();
+
+    // Brings the frame-builder's list of live records up to date for the specified frame number
+    void        updateLiveRecords(frameBuilder_t& fb, uint32_t frameNumber) const;
+
+    // Brings the frame-builder's list of the cells that each live record owns up to date.  Returns
+    // the index in fb.owned of the first entry whose cells have just changed hands
+    template <bool LVDS> size_t updateOwnedCells(frameBuilder_t& fb) const;
+
+    // Rebuilds the frame-builder's owned cells from scratch
+    template <bool LVDS> void resolveOwnedCells(frameBuilder_t& fb) const;
+
+    // Hands the cells of fb.expired to whichever live records own them now
+    template <bool LVDS> void handOverCells(frameBuilder_t& fb) const;
+
+    // Appends spans (and entries in fb.owned) for a list of (record, position) pairs sorted by record
+    void        appendOwnedCells(frameBuilder_t& fb, const std::vector<std::pair<uint32_t, uint32_t>>& cells) const;
+
+    // Returns the number of threads that should share the parsing of an input file of this size
+    int         parsingThreads(size_t fileSize) const;
+
+    // The configuration and options we were constructed with
+    config_t            m_config;
+    generatorOptions_t  m_options;
+
+    // The compiled fragment and distribution definitions, which may be shared with other generators
+    std::shared_ptr<compiledInputs_t> m_inputs;
+
+    // Frames in which every cell holds the same value, indexed by that value
+    std::vector<uint8_t>    m_uniformFrame[256];
+
+    // How cell data gets into LVDS order, and the kernel that does it when there's a re-order pass
+    bool                    m_lvdsFused, m_lvdsReorderPass;
+    lvdsKernel_t            m_lvdsKernel;
+};
+//----------------------------------------------------------------------------------------------------------
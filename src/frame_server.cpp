@@ -0,0 +1,246 @@
+//==========================================================================================================
+// frame_server.cpp - Implements the on-demand frame server and its frame cache
+//==========================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+#include "frame_server.h"
+#include "errors.h"
+
+using namespace std;
+
+// The "magic number" that a client receives when it connects
+static const char SERVER_MAGIC[8] = {'E', 'S', 'P', 'S', 'R', 'V', '0', '1'};
+
+// The most frame data that gets gathered up before being sent
+static const size_t SEND_BUFFER_SIZE = 4 * 1024 * 1024;
+
+
+//==========================================================================================================
+// readAll() - Reads exactly 'length' bytes from a socket.  Returns false if the connection closes first
+//==========================================================================================================
+static bool readAll(int fd, void* data, size_t length)
+{
+    uint8_t* p = (uint8_t*)data;
+    while (length)
+    {
+        ssize_t n = ::read(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// sendAll() - Sends all of 'length' bytes to a socket.  Returns false if the connection has gone away
+//==========================================================================================================
+static bool sendAll(int fd, const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (length)
+    {
+        ssize_t n = ::send(fd, p, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// CFrameCache::fetch() - If the frame is in the cache, copies it to 'dst' and marks it most recently used
+//==========================================================================================================
+bool CFrameCache::fetch(uint64_t frameIndex, uint8_t* dst)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    auto it = m_index.find(frameIndex);
+    if (it == m_index.end())
+    {
+        ++m_misses;
+        return false;
+    }
+
+    // Move the frame to the front of the LRU list, and hand it to the caller
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    memcpy(dst, it->second->data.data(), m_frameSize);
+    ++m_hits;
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CFrameCache::store() - Adds a frame to the cache, discarding the least recently used one if the cache
+//                        is full
+//==========================================================================================================
+void CFrameCache::store(uint64_t frameIndex, const uint8_t* frame)
+{
+    if (m_capacity == 0) return;
+
+    lock_guard<mutex> lock(m_mutex);
+
+    // If another thread cached this frame while we were building it, there's nothing to do
+    if (m_index.count(frameIndex)) return;
+
+    // If the cache is full, recycle the least recently used entry.  Otherwise, make a new one
+    if (m_lru.size() >= m_capacity)
+    {
+        m_index.erase(m_lru.back().frameIndex);
+        m_lru.splice(m_lru.begin(), m_lru, prev(m_lru.end()));
+    }
+    else
+    {
+        m_lru.push_front({0, vector<uint8_t>(m_frameSize)});
+    }
+
+    // Fill in the entry and index it
+    entry_t& entry = m_lru.front();
+    entry.frameIndex = frameIndex;
+    memcpy(entry.data.data(), frame, m_frameSize);
+    m_index[frameIndex] = m_lru.begin();
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// CFrameServer() - Constructor
+//==========================================================================================================
+CFrameServer::CFrameServer(const CFrameGenerator& generator, uint64_t cacheBytes)
+    : m_generator(generator), m_cache(generator.frameSize(), cacheBytes / generator.frameSize())
+{
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// run() - Listens for clients, and serves each of them on a thread of its own
+//==========================================================================================================
+void CFrameServer::run(string path)
+{
+    sockaddr_un address = {};
+
+    // Make sure the path will fit into a socket address
+    if (path.size() >= sizeof address.sun_path) throw runtime_error("Socket path is too long: " + path);
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+
+    // Create the socket.  If a previous server left its socket behind, get rid of it
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) throwErrno("Can't create", path, errno);
+    unlink(path.c_str());
+    if (bind(listener, (sockaddr*)&address, sizeof address) < 0 || listen(listener, 16) < 0)
+    {
+        int error = errno;
+        ::close(listener);
+        throwErrno("Can't listen on", path, error);
+    }
+
+    printf("Serving %lu frames of %u bytes on %s\n", m_generator.frameCount(), m_generator.frameSize(), path.c_str());
+    fflush(stdout);
+
+    // Serve clients until we're killed
+    while (true)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            int error = errno;
+            ::close(listener);
+            throwErrno("Can't accept a connection on", path, error);
+        }
+        thread(&CFrameServer::serveClient, this, fd).detach();
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// serveClient() - Answers the requests of a single client until it disconnects
+//==========================================================================================================
+void CFrameServer::serveClient(int fd)
+{
+    uint32_t frameSize  = m_generator.frameSize();
+    uint64_t frameCount = m_generator.frameCount();
+
+    // This connection has its own frame-builder, and its own buffer of frames waiting to be sent
+    frameBuilder_t  fb;
+    size_t          batchFrames = max<size_t>(1, SEND_BUFFER_SIZE / frameSize);
+    vector<uint8_t> buffer(batchFrames * frameSize);
+    uint64_t        framesServed = 0;
+
+    // Tell the client what the image looks like
+    uint8_t hello[24];
+    uint32_t reserved = 0;
+    memcpy(hello,      SERVER_MAGIC, 8);
+    memcpy(hello + 8,  &frameSize,   4);
+    memcpy(hello + 12, &reserved,    4);
+    memcpy(hello + 16, &frameCount,  8);
+    bool ok = sendAll(fd, hello, sizeof hello);
+
+    // Answer one request after another
+    uint64_t request[2];
+    while (ok && readAll(fd, request, sizeof request))
+    {
+        // Clip the requested range to the image
+        uint64_t first = min(request[0], frameCount);
+        uint64_t end   = max(first, min(request[1], frameCount));
+        uint64_t count = end - first;
+        ok = sendAll(fd, &count, sizeof count);
+
+        // Send the frames, a batch at a time
+        for (uint64_t frameIndex = first; ok && frameIndex < end;)
+        {
+            size_t n = min<uint64_t>(batchFrames, end - frameIndex);
+            for (size_t i=0; i<n; ++i) fetchFrame(fb, frameIndex + i, buffer.data() + i * frameSize);
+            ok = sendAll(fd, buffer.data(), n * frameSize);
+            frameIndex += n;
+        }
+        framesServed += count;
+    }
+
+    // The client has gone away
+    ::close(fd);
+    printf("Served %lu frames to a client.  Cache hits: %lu, misses: %lu\n",
+           framesServed, m_cache.hits(), m_cache.misses());
+    fflush(stdout);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// fetchFrame() - Fetches a frame from the cache, or builds it if it isn't there
+//
+// Uniform frames (diagnostic frames, and data frames past the end of every sequence) are cheaper to
+// build than to look up, so they're never cached
+//==========================================================================================================
+void CFrameServer::fetchFrame(frameBuilder_t& fb, uint64_t frameIndex, uint8_t* dst)
+{
+    if (m_generator.isUniformFrame(frameIndex))
+    {
+        m_generator.buildFrame(fb, dst, frameIndex);
+        return;
+    }
+
+    if (m_cache.fetch(frameIndex, dst)) return;
+
+    m_generator.buildFrame(fb, dst, frameIndex);
+    m_cache.store(frameIndex, dst);
+}
+//==========================================================================================================
@@ -0,0 +1,103 @@
+//==========================================================================================================
+// frame_server.h - Defines a server that hands out frames on demand over a UNIX-domain socket
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include "frame_generator.h"
+
+
+//----------------------------------------------------------------------------------------------------------
+// CFrameCache - A thread-safe cache of recently used frames.  When it's full, the least recently used
+//               frame is discarded to make room
+//----------------------------------------------------------------------------------------------------------
+class CFrameCache
+{
+public:
+
+    // 'frameSize' is the number of bytes in a frame, 'capacity' is the maximum number of frames held
+    CFrameCache(uint32_t frameSize, size_t capacity) {m_frameSize = frameSize; m_capacity = capacity;}
+
+    // If the frame is in the cache, copies it to 'dst' and returns true
+    bool    fetch(uint64_t frameIndex, uint8_t* dst);
+
+    // Adds a frame to the cache
+    void    store(uint64_t frameIndex, const uint8_t* frame);
+
+    // The number of lookups that found their frame, and the number that didn't
+    uint64_t hits()   const {std::lock_guard<std::mutex> lock(m_mutex); return m_hits;}
+    uint64_t misses() const {std::lock_guard<std::mutex> lock(m_mutex); return m_misses;}
+
+protected:
+
+    // A cached frame
+    struct entry_t
+    {
+        uint64_t             frameIndex;
+        std::vector<uint8_t> data;
+    };
+
+    // The cached frames, most recently used first, and the index that finds them
+    std::list<entry_t> m_lru;
+    std::unordered_map<uint64_t, std::list<entry_t>::iterator> m_index;
+
+    uint32_t    m_frameSize;
+    size_t      m_capacity;
+    uint64_t    m_hits = 0, m_misses = 0;
+    mutable std::mutex m_mutex;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CFrameServer - Listens on a UNIX-domain socket and answers requests for ranges of frames, building
+//                them on demand.   Each client connection is served by a thread of its own.
+//
+// All integers are in the byte order of the machine.  When a client connects, the server sends:
+//
+//     char     magic[8]      "ESPSRV01"
+//     uint32_t frameSize     The number of bytes in a frame
+//     uint32_t reserved
+//     uint64_t frameCount    The number of frames in the image
+//
+// The client then sends any number of requests, each of which is:
+//
+//     uint64_t first         The index of the first frame wanted
+//     uint64_t end           The index just past the last frame wanted
+//
+// and the server answers each with:
+//
+//     uint64_t count         The number of frames that follow.  The range is clipped to the end of the
+//                            image, so this is less than (end - first) if the range runs past it
+//     uint8_t  frames[count * frameSize]
+//----------------------------------------------------------------------------------------------------------
+class CFrameServer
+{
+public:
+
+    // 'cacheBytes' is how much memory the cache of recently requested frames may occupy
+    CFrameServer(const CFrameGenerator& generator, uint64_t cacheBytes);
+
+    // Serves clients on the socket at 'path' forever.  Can throw exception runtime_error
+    void    run(std::string path);
+
+protected:
+
+    // Answers the requests of a single client until it disconnects
+    void    serveClient(int fd);
+
+    // Fetches a frame from the cache, or builds it (and caches it) if it isn't there
+    void    fetchFrame(frameBuilder_t& fb, uint64_t frameIndex, uint8_t* dst);
+
+    // The generator that builds the frames
+    const CFrameGenerator& m_generator;
+
+    // Recently requested frames
+    CFrameCache     m_cache;
+};
+//----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,742 @@
+//==========================================================================================================
+// frame_writer.cpp - Implements the back-ends that write frame data to the output file
+//==========================================================================================================
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "frame_writer.h"
+#include "errors.h"
+
+using namespace std;
+
+// O_DIRECT requires buffers, lengths and file offsets to be aligned to this many bytes
+static const size_t DIRECT_ALIGN = 4096;
+
+
+//==========================================================================================================
+// CStdioWriter::open() - Creates the output file
+//==========================================================================================================
+void CStdioWriter::open(string filename, uint64_t)
+{
+    m_file = fopen(filename.c_str(), "w");
+    if (m_file == nullptr) throw runtime_error("Can't create " + filename);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CStdioWriter::write() - Appends data to the output file
+//==========================================================================================================
+void CStdioWriter::write(const uint8_t* data, size_t length)
+{
+    if (fwrite(data, 1, length, m_file) != length) throw runtime_error("Write to output file failed");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CStdioWriter::close() - Flushes whatever stdio is still buffering and closes the output file
+//==========================================================================================================
+void CStdioWriter::close()
+{
+    if (m_file == nullptr) return;
+
+    // Close the output file and complain if that fails
+    int status = fclose(m_file);
+    m_file = nullptr;
+    if (status != 0) throwErrno("Error closing", "output file", errno);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// CDirectWriter() - Constructor.  Allocates the two aligned buffers
+//==========================================================================================================
+CDirectWriter::CDirectWriter(size_t bufferSize)
+{
+    // Round the buffer size up to a multiple of the O_DIRECT alignment
+    m_bufferSize = (bufferSize + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    if (m_bufferSize == 0) m_bufferSize = DIRECT_ALIGN;
+
+    // Allocate both buffers on an aligned boundary
+    for (int i=0; i<2; ++i)
+    {
+        void* p = nullptr;
+        if (posix_memalign(&p, DIRECT_ALIGN, m_bufferSize) != 0) throw runtime_error("Out of memory");
+        m_buffer[i] = (uint8_t*)p;
+    }
+
+    // We don't have an output file yet
+    m_fd = -1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// ~CDirectWriter() - Destructor.  Shuts down the background thread and frees the buffers
+//==========================================================================================================
+CDirectWriter::~CDirectWriter()
+{
+    // If the caller never called close(), shut down the background thread
+    if (m_thread.joinable())
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_cvJob.notify_all();
+        m_thread.join();
+    }
+
+    // Close the output file if it's still open
+    if (m_fd >= 0) ::close(m_fd);
+
+    // Free the buffers
+    free(m_buffer[0]);
+    free(m_buffer[1]);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Creates the output file and starts the background thread
+//==========================================================================================================
+void CDirectWriter::open(string filename, uint64_t)
+{
+    // Try to open the output file for direct I/O
+    m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+    m_isDirect = (m_fd >= 0);
+
+    // Some file-systems (tmpfs, for instance) don't support O_DIRECT.  Fall back to buffered I/O
+    if (m_fd < 0 && errno == EINVAL)
+    {
+        printf("O_DIRECT isn't supported for %s, using buffered I/O\n", filename.c_str());
+        m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+
+    // If we couldn't create the output file, complain
+    if (m_fd < 0) throwErrno("Can't create", filename, errno);
+
+    // Start the background thread that writes buffers to disk
+    startIoThread();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// startIoThread() - Resets the buffers and starts the background thread that writes them
+//==========================================================================================================
+void CDirectWriter::startIoThread()
+{
+    // Nothing has been buffered or written yet
+    m_fillIndex  = 0;
+    m_fillLength = 0;
+    m_fileOffset = 0;
+    m_jobPending = false;
+    m_quit       = false;
+    m_ioError    = 0;
+
+    // Start the background thread
+    m_thread = thread(&CDirectWriter::ioThread, this);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// write() - Gathers data into the fill-buffer, handing the buffer to the background thread each time
+//           it fills up
+//==========================================================================================================
+void CDirectWriter::write(const uint8_t* data, size_t length)
+{
+    while (length)
+    {
+        // How many bytes of this data will fit into the fill-buffer?
+        size_t chunk = m_bufferSize - m_fillLength;
+        if (chunk > length) chunk = length;
+
+        // Append that data to the fill-buffer
+        memcpy(m_buffer[m_fillIndex] + m_fillLength, data, chunk);
+        m_fillLength += chunk;
+        data         += chunk;
+        length       -= chunk;
+
+        // If the fill-buffer is full, hand it to the background thread to be written
+        if (m_fillLength == m_bufferSize) submitFillBuffer();
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close() - Writes whatever remains in the fill-buffer, then closes the output file
+//==========================================================================================================
+void CDirectWriter::close()
+{
+    // Wait for the background thread to finish the buffer it's writing
+    waitForIdle();
+
+    // Shut down the background thread
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cvJob.notify_all();
+    m_thread.join();
+
+    // The tail of the file is probably not a multiple of the O_DIRECT alignment
+    if (m_fillLength)
+    {
+        // Write as much of the tail as we can with direct I/O
+        size_t alignedLength = m_isDirect ? m_fillLength / DIRECT_ALIGN * DIRECT_ALIGN : 0;
+        int error = writeBlock(m_buffer[m_fillIndex], alignedLength, m_fileOffset);
+
+        // Turn off O_DIRECT and write whatever is left over
+        if (m_isDirect) fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+        if (error == 0) error = writeBlock(m_buffer[m_fillIndex] + alignedLength,
+                                           m_fillLength - alignedLength, m_fileOffset + alignedLength);
+        if (error) throwErrno("Error writing", "output file", error);
+        m_fileOffset += m_fillLength;
+        m_fillLength  = 0;
+    }
+
+    // Close the output file and complain if that fails
+    int status = ::close(m_fd);
+    m_fd = -1;
+    if (status != 0) throwErrno("Error closing", "output file", errno);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// submitFillBuffer() - Hands the fill-buffer to the background thread and switches to the other buffer
+//==========================================================================================================
+void CDirectWriter::submitFillBuffer()
+{
+    // The other buffer may still be being written.  Wait for it to finish
+    waitForIdle();
+
+    // Hand the fill-buffer to the background thread
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_jobData    = m_buffer[m_fillIndex];
+        m_jobLength  = m_fillLength;
+        m_jobOffset  = m_fileOffset;
+        m_jobPending = true;
+    }
+    m_cvJob.notify_all();
+
+    // The next buffer will be written just after this one
+    m_fileOffset += m_fillLength;
+
+    // And start filling the other buffer
+    m_fillIndex  = 1 - m_fillIndex;
+    m_fillLength = 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// waitForIdle() - Waits for the background thread to finish writing its buffer.   If the background
+//                 thread encountered an error, this throws it
+//==========================================================================================================
+void CDirectWriter::waitForIdle()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_cvIdle.wait(lock, [this]{return !m_jobPending;});
+    if (m_ioError) throwErrno("Error writing", "output file", m_ioError);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// ioThread() - Waits for buffers to be handed to us, and writes them to the output file
+//==========================================================================================================
+void CDirectWriter::ioThread()
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    while (true)
+    {
+        // Wait for either a buffer to write or a request to quit
+        m_cvJob.wait(lock, [this]{return m_jobPending || m_quit;});
+        if (!m_jobPending) break;
+
+        // Write the buffer without holding the lock
+        lock.unlock();
+        int error = writeBlock(m_jobData, m_jobLength, m_jobOffset);
+        lock.lock();
+
+        // Tell the foreground that we're idle again
+        if (error) m_ioError = error;
+        m_jobPending = false;
+        m_cvIdle.notify_all();
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// writeBlock() - Writes an entire block of data to the output file, retrying partial writes
+//
+// Returns: 0 on success, otherwise the value of errno
+//==========================================================================================================
+int CDirectWriter::writeBlock(const uint8_t* data, size_t length, uint64_t offset)
+{
+    while (length)
+    {
+        ssize_t written = pwrite(m_fd, data, length, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <  0) return errno;
+        if (written == 0) return EIO;
+        data   += written;
+        length -= written;
+        offset += written;
+    }
+
+    return 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// This is the real stdout, once reserveStdout() has set it aside
+//==========================================================================================================
+int CStreamWriter::s_stdoutFd = -1;
+//==========================================================================================================
+
+
+//==========================================================================================================
+// isStreamTarget() - Returns true if the target is stdout or a TCP connection
+//==========================================================================================================
+bool CStreamWriter::isStreamTarget(const string& target)
+{
+    return target == "-" || target.compare(0, 6, "tcp://") == 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// reserveStdout() - Sets the real stdout aside for streaming, and sends everything that gets displayed
+//                   to stderr instead
+//==========================================================================================================
+void CStreamWriter::reserveStdout()
+{
+    if (s_stdoutFd >= 0) return;
+    fflush(stdout);
+    s_stdoutFd = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Opens the stream and starts the background thread
+//==========================================================================================================
+void CStreamWriter::open(string target, uint64_t)
+{
+    // If the reader goes away, we want an EPIPE error rather than being killed by SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    // Either write to stdout or connect to the remote host
+    if (target == "-")
+        m_fd = (s_stdoutFd >= 0) ? dup(s_stdoutFd) : dup(STDOUT_FILENO);
+    else
+        m_fd = connectTcp(target.substr(6));
+
+    if (m_fd < 0) throwErrno("Can't open", target, errno);
+
+    // Streams don't support O_DIRECT
+    m_isDirect = false;
+
+    // Start the background thread that sends the buffers
+    startIoThread();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// connectTcp() - Connects to a remote host, specified as "host:port"
+//==========================================================================================================
+int CStreamWriter::connectTcp(string hostPort)
+{
+    // Split the target into host and port
+    size_t colon = hostPort.rfind(':');
+    if (colon == string::npos) throw runtime_error("Invalid TCP target 'tcp://" + hostPort + "'");
+    string host = hostPort.substr(0, colon);
+    string port = hostPort.substr(colon + 1);
+
+    // Look up the address of the remote host
+    addrinfo hints = {}, *list;
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &list);
+    if (error) throw runtime_error("Can't resolve " + hostPort + ": " + gai_strerror(error));
+
+    // Try each address until one of them accepts our connection
+    int sd = -1;
+    for (addrinfo* ai = list; ai; ai = ai->ai_next)
+    {
+        sd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sd < 0) continue;
+        if (connect(sd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        error = errno;
+        ::close(sd);
+        sd = -1;
+        errno = error;
+    }
+    freeaddrinfo(list);
+
+    // Let the kernel queue up an entire buffer's worth of data
+    if (sd >= 0)
+    {
+        int size = (m_bufferSize > 0x40000000) ? 0x40000000 : (int)m_bufferSize;
+        setsockopt(sd, SOL_SOCKET, SO_SNDBUF, &size, sizeof size);
+    }
+
+    return sd;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// writeBlock() - Writes an entire block of data to the stream, retrying partial writes
+//
+// Returns: 0 on success, otherwise the value of errno
+//==========================================================================================================
+int CStreamWriter::writeBlock(const uint8_t* data, size_t length, uint64_t)
+{
+    while (length)
+    {
+        ssize_t written = ::write(m_fd, data, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <  0) return errno;
+        if (written == 0) return EIO;
+        data   += written;
+        length -= written;
+    }
+
+    return 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// ~CMappedWriter() - Destructor.  Unmaps and closes the output file if the caller didn't call close()
+//==========================================================================================================
+CMappedWriter::~CMappedWriter()
+{
+    if (m_base) munmap(m_base, m_size);
+    if (m_fd >= 0) ::close(m_fd);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Creates the output file, allocates its disk space, and maps it into memory
+//==========================================================================================================
+void CMappedWriter::open(string filename, uint64_t totalBytes)
+{
+    // Create the output file
+    m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (m_fd < 0) throwErrno("Can't create", filename, errno);
+
+    // Allocate all of the disk space the file will need up front
+    int error = posix_fallocate(m_fd, 0, totalBytes);
+
+    // If that's not supported by this file-system, just set the size of the file
+    if (error == EOPNOTSUPP || error == EINVAL)
+    {
+        error = (ftruncate(m_fd, totalBytes) == 0) ? 0 : errno;
+    }
+
+    // If we couldn't size the file, complain
+    if (error) throwErrno("Can't allocate space for", filename, error);
+
+    // An empty file has nothing to map
+    m_size = totalBytes;
+    m_writeOffset = 0;
+    if (m_size == 0) return;
+
+    // Map the entire file into memory
+    void* p = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (p == MAP_FAILED) throwErrno("Can't map", filename, errno);
+    m_base = (uint8_t*)p;
+
+    // We'll be writing it front to back
+    madvise(m_base, m_size, MADV_SEQUENTIAL);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// write() - Copies data into the mapped file, just after the data from the previous call to write()
+//==========================================================================================================
+void CMappedWriter::write(const uint8_t* data, size_t length)
+{
+    if (m_writeOffset + length > m_size) throw runtime_error("Write past the end of the output file");
+    memcpy(m_base + m_writeOffset, data, length);
+    m_writeOffset += length;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close() - Writes the mapped data back to the output file, then unmaps and closes it
+//
+// Without the msync(), a failure to write the data back (a full disk, or an I/O error) would never
+// be reported.  A device with nothing behind it to write back to (such as /dev/mem) can't be synced
+// and reports EINVAL, which is harmless
+//==========================================================================================================
+void CMappedWriter::close()
+{
+    int error = 0;
+    if (m_base && msync(m_base, m_size, MS_SYNC) != 0 && errno != EINVAL) error = errno;
+    if (m_base) munmap(m_base, m_size);
+    m_base = nullptr;
+
+    int status = ::close(m_fd);
+    m_fd = -1;
+    if (error) throwErrno("Error writing", "output file", error);
+    if (status != 0) throwErrno("Error closing", "output file", errno);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// CContigWriter::open() - Maps the specified region of the contiguous buffer device into memory
+//==========================================================================================================
+void CContigWriter::open(string device, uint64_t totalBytes)
+{
+    struct stat st;
+
+    // Memory mappings must begin on a page boundary
+    if (m_offset % sysconf(_SC_PAGESIZE) != 0)
+    {
+        throw runtime_error("contig_offset must be a multiple of the page size");
+    }
+
+    // Open the device that exposes the contiguous buffer
+    m_fd = ::open(device.c_str(), O_RDWR);
+    if (m_fd < 0) throwErrno("Can't open", device, errno);
+
+    // If the "device" is actually a regular file, make sure it's big enough.  (Touching a mapping
+    // beyond the end of a file would crash us with a SIGBUS)
+    if (fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode) && (uint64_t)st.st_size < m_offset + totalBytes)
+    {
+        throw runtime_error(device + " is too small to hold the output");
+    }
+
+    // Map the portion of the contiguous buffer that we're going to fill
+    m_size = totalBytes;
+    void* p = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, m_offset);
+    if (p == MAP_FAILED) throwErrno("Can't map", device, errno);
+    m_base = (uint8_t*)p;
+    m_writeOffset = 0;
+}
+//==========================================================================================================
+
+
+
+// The magic number at the start of every run-length encoded file
+const char CRleWriter::MAGIC[8] = {'E', 'S', 'P', 'R', 'L', 'E', '0', '1'};
+
+//==========================================================================================================
+// CRleWriter() - Constructor
+//==========================================================================================================
+CRleWriter::CRleWriter(CFrameWriter* inner, uint32_t frameSize) : m_inner(inner)
+{
+    m_frameSize = frameSize;
+    m_runCount  = 0;
+    m_runFrame.resize(frameSize);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Creates the output file and writes the file header
+//==========================================================================================================
+void CRleWriter::open(string filename, uint64_t totalBytes)
+{
+    uint64_t totalFrames = totalBytes / m_frameSize;
+
+    // Create the output file
+    m_inner->open(filename, totalBytes);
+
+    // Write the file header
+    m_inner->write((const uint8_t*)MAGIC,        sizeof MAGIC      );
+    m_inner->write((const uint8_t*)&m_frameSize, sizeof m_frameSize);
+    m_inner->write((const uint8_t*)&totalFrames, sizeof totalFrames);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// write() - Splits the incoming data into frames and run-length encodes them
+//==========================================================================================================
+void CRleWriter::write(const uint8_t* data, size_t length)
+{
+    // If there is a partial frame left over from last time, try to complete it 
+    if (!m_partial.empty())
+    {
+        size_t needed = m_frameSize - m_partial.size();
+        if (needed > length) needed = length;
+        m_partial.insert(m_partial.end(), data, data + needed);
+        data   += needed;
+        length -= needed;
+        if (m_partial.size() < m_frameSize) return;
+        addFrame(m_partial.data());
+        m_partial.clear();
+    }
+
+    // Encode every complete frame
+    while (length >= m_frameSize)
+    {
+        addFrame(data);
+        data   += m_frameSize;
+        length -= m_frameSize;
+    }
+
+    // Save whatever is left over for next time
+    m_partial.assign(data, data + length);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close() - Writes the final run and closes the output file
+//==========================================================================================================
+void CRleWriter::close()
+{
+    if (!m_partial.empty()) throw runtime_error("Output data doesn't end on a frame boundary");
+    flushRun();
+    m_inner->close();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// addFrame() - Extends the current run if this frame is the same as the run's frame, otherwise writes
+//              the current run and starts a new one
+//==========================================================================================================
+void CRleWriter::addFrame(const uint8_t* frame)
+{
+    // If this frame is a repeat of the previous one, just count it
+    if (m_runCount && m_runCount < UINT32_MAX && memcmp(frame, m_runFrame.data(), m_frameSize) == 0)
+    {
+        ++m_runCount;
+        return;
+    }
+
+    // Otherwise, this frame starts a new run
+    flushRun();
+    memcpy(m_runFrame.data(), frame, m_frameSize);
+    m_runCount = 1;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// flushRun() - Writes the current run to the inner back-end
+//==========================================================================================================
+void CRleWriter::flushRun()
+{
+    if (m_runCount == 0) return;
+    m_inner->write((const uint8_t*)&m_runCount, sizeof m_runCount);
+    m_inner->write(m_runFrame.data(), m_frameSize);
+    m_runCount = 0;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// isRleFile() - Returns true if the file begins with the run-length encoded format's magic number
+//==========================================================================================================
+bool CRleReader::isRleFile(string filename)
+{
+    char magic[sizeof CRleWriter::MAGIC];
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool result = ::read(fd, magic, sizeof magic) == sizeof magic
+               && memcmp(magic, CRleWriter::MAGIC, sizeof magic) == 0;
+    ::close(fd);
+    return result;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Opens a run-length encoded file and reads its header
+//==========================================================================================================
+void CRleReader::open(string filename)
+{
+    char magic[sizeof CRleWriter::MAGIC];
+
+    // Get rid of any file that's already open
+    if (m_file) fclose(m_file);
+
+    // Open the file
+    m_filename = filename;
+    m_file = fopen(filename.c_str(), "r");
+    if (m_file == nullptr) throw runtime_error("Can't open " + filename);
+
+    // Read the file header and make sure this really is a run-length encoded file
+    if (fread(magic,         1, sizeof magic,        m_file) != sizeof magic
+    ||  fread(&m_frameSize,  1, sizeof m_frameSize,  m_file) != sizeof m_frameSize
+    ||  fread(&m_frameCount, 1, sizeof m_frameCount, m_file) != sizeof m_frameCount
+    ||  memcmp(magic, CRleWriter::MAGIC, sizeof magic) != 0 || m_frameSize == 0)
+    {
+        throw runtime_error(filename + " is not a run-length encoded file");
+    }
+
+    m_framesRead = 0;
+    m_runLeft    = 0;
+    m_runFrame.resize(m_frameSize);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// read() - Fetches the next 'count' frames, reading a new run each time the current one runs out
+//==========================================================================================================
+void CRleReader::read(uint64_t count, uint8_t* dst)
+{
+    if (m_framesRead + count > m_frameCount)
+    {
+        throw runtime_error(m_filename + " doesn't have frame " + to_string(m_framesRead + count - 1));
+    }
+
+    while (count)
+    {
+        // Fetch the next run if we've handed out every frame of this one
+        if (m_runLeft == 0)
+        {
+            if (fread(&m_runLeft, 1, sizeof m_runLeft, m_file) != sizeof m_runLeft
+            ||  fread(m_runFrame.data(), 1, m_frameSize, m_file) != m_frameSize)
+            {
+                throw runtime_error(m_filename + " is truncated");
+            }
+            continue;
+        }
+
+        // Hand out as many copies of the run's frame as we can
+        uint32_t frames = min<uint64_t>(count, m_runLeft);
+        for (uint32_t i=0; i<frames; ++i, dst += m_frameSize) memcpy(dst, m_runFrame.data(), m_frameSize);
+        m_runLeft    -= frames;
+        m_framesRead += frames;
+        count        -= frames;
+    }
+}
+//==========================================================================================================
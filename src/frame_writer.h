@@ -0,0 +1,335 @@
+//==========================================================================================================
+// frame_writer.h - Defines the back-ends that write frame data to the output file, and the reader of
+//                  run-length encoded files
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <memory>
+#include <vector>
+
+
+//----------------------------------------------------------------------------------------------------------
+// CFrameWriter - The interface that every output back-end provides.   Data is written sequentially,
+//                starting at the beginning of the output file
+//----------------------------------------------------------------------------------------------------------
+class CFrameWriter
+{
+public:
+
+    // Back-ends are destroyed via a pointer to this interface
+    virtual ~CFrameWriter() {}
+
+    // Call this to create the output file.  'totalBytes' is the size the file will eventually be
+    // Can throw exception runtime_error
+    virtual void open(std::string filename, uint64_t totalBytes) = 0;
+
+    // Call this to append data to the output file.   Can throw exception runtime_error
+    virtual void write(const uint8_t* data, size_t length) = 0;
+
+    // Call this to flush any buffered data and close the output file.  Can throw exception runtime_error
+    virtual void close() = 0;
+
+    // If the output file is mapped into memory, this returns the address of its first byte.
+    // Frames may then be built directly into the mapping, in any order, instead of via write()
+    virtual uint8_t* mappedBase() {return nullptr;}
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CStdioWriter - Writes the output file via ordinary buffered stdio
+//----------------------------------------------------------------------------------------------------------
+class CStdioWriter : public CFrameWriter
+{
+public:
+
+    CStdioWriter() {m_file = nullptr;}
+    ~CStdioWriter() {if (m_file) fclose(m_file);}
+
+    void    open(std::string filename, uint64_t totalBytes);
+    void    write(const uint8_t* data, size_t length);
+    void    close();
+
+protected:
+
+    // The output file
+    FILE*   m_file;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CDirectWriter - Gathers data into large aligned buffers and writes them with O_DIRECT pwrite() calls.
+//
+// There are two buffers: while a background thread is writing one of them to disk, the caller is
+// filling the other.  If the output file-system doesn't support O_DIRECT, ordinary buffered I/O is
+// used instead.
+//----------------------------------------------------------------------------------------------------------
+class CDirectWriter : public CFrameWriter
+{
+public:
+
+    // 'bufferSize' is the size of each of the two buffers, and is rounded up to a multiple of 4K
+    CDirectWriter(size_t bufferSize);
+    ~CDirectWriter();
+
+    void    open(std::string filename, uint64_t totalBytes);
+    void    write(const uint8_t* data, size_t length);
+    void    close();
+
+protected:
+
+    // Hands the fill-buffer to the background thread and starts filling the other buffer
+    void    submitFillBuffer();
+
+    // Waits for the background thread to finish writing the buffer it's working on
+    void    waitForIdle();
+
+    // Resets the buffers and starts the background thread, once m_fd is open
+    void    startIoThread();
+
+    // This is the code that runs in the background thread
+    void    ioThread();
+
+    // Writes an entire block to the output file at the specified offset.  Returns 0 or an errno
+    virtual int writeBlock(const uint8_t* data, size_t length, uint64_t offset);
+
+    // The size of each buffer, and the buffers themselves
+    size_t      m_bufferSize;
+    uint8_t*    m_buffer[2];
+
+    // Index of the buffer being filled, and how many bytes are in it
+    int         m_fillIndex;
+    size_t      m_fillLength;
+
+    // The file descriptor of the output file, and whether it was opened with O_DIRECT
+    int         m_fd;
+    bool        m_isDirect;
+
+    // The file offset where the next submitted buffer will be written
+    uint64_t    m_fileOffset;
+
+    // The background thread, and the job it has been handed
+    std::thread m_thread;
+    const uint8_t* m_jobData;
+    size_t      m_jobLength;
+    uint64_t    m_jobOffset;
+    bool        m_jobPending, m_quit;
+
+    // If the background thread encounters an error, this is the value of errno
+    int         m_ioError;
+
+    // These synchronize us with the background thread
+    std::mutex              m_mutex;
+    std::condition_variable m_cvJob, m_cvIdle;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CStreamWriter - Streams the output to stdout (target "-") or to a TCP connection (target 
+//                 "tcp://host:port") for loading directly on another machine.
+//
+// Data is gathered into large buffers exactly as CDirectWriter does, and the background thread sends one
+// buffer while the caller builds frames into the other, which keeps the pipe or the NIC busy.
+//----------------------------------------------------------------------------------------------------------
+class CStreamWriter : public CDirectWriter
+{
+public:
+
+    // 'bufferSize' is the size of each of the two buffers
+    CStreamWriter(size_t bufferSize) : CDirectWriter(bufferSize) {}
+
+    void    open(std::string target, uint64_t totalBytes);
+
+    // Returns true if 'target' names a stream rather than a file
+    static bool isStreamTarget(const std::string& target);
+
+    // Call this before anything is displayed when the output will be streamed to stdout.  It sets
+    // the real stdout aside for the stream, and points stdout at stderr so messages can't corrupt it
+    static void reserveStdout();
+
+protected:
+
+    // Streams ignore the offset and write the data in the order it's handed to us
+    int     writeBlock(const uint8_t* data, size_t length, uint64_t offset);
+
+    // Connects to "host:port" and returns the socket.   Can throw exception runtime_error
+    int     connectTcp(std::string hostPort);
+
+    // If reserveStdout() has been called, this is the file descriptor of the real stdout
+    static int s_stdoutFd;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CMappedWriter - Preallocates the output file at its final size and maps it into memory so that frames
+//                 can be built directly into it
+//----------------------------------------------------------------------------------------------------------
+class CMappedWriter : public CFrameWriter
+{
+public:
+
+    CMappedWriter() {m_fd = -1; m_base = nullptr;}
+    ~CMappedWriter();
+
+    void     open(std::string filename, uint64_t totalBytes);
+    void     write(const uint8_t* data, size_t length);
+    void     close();
+    uint8_t* mappedBase() {return m_base;}
+
+protected:
+
+    // The file descriptor of the output file
+    int         m_fd;
+
+    // The address and size of the memory mapping
+    uint8_t*    m_base;
+    uint64_t    m_size;
+
+    // The offset where the next call to write() will store its data
+    uint64_t    m_writeOffset;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CContigWriter - Maps the contiguous DMA buffer (via /dev/mem, a UIO device, or a udmabuf device) and lets
+//                 frames be built directly into it.  The device is never created or resized
+//----------------------------------------------------------------------------------------------------------
+class CContigWriter : public CMappedWriter
+{
+public:
+
+    // 'offset' is the offset within the device where the contiguous buffer begins
+    CContigWriter(uint64_t offset) {m_offset = offset;}
+
+    void     open(std::string device, uint64_t totalBytes);
+
+protected:
+
+    // The offset within the device of the first byte of the contiguous buffer
+    uint64_t    m_offset;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CRleWriter - Writes frames in the compact "run-length" format, in which each run of identical consecutive
+//              frames is stored just once along with its repeat count.   The resulting data is handed to
+//              some other back-end to be written.
+//
+// File format (all integers are little-endian):
+//
+//    Header : 8-byte magic "ESPRLE01", uint32 bytes-per-frame, uint64 total frame count
+//    Runs   : uint32 repeat count, followed by one frame of data, repeated until end-of-file
+//
+// A loader expands the file by writing each run's frame 'repeat count' times in succession
+//----------------------------------------------------------------------------------------------------------
+class CRleWriter : public CFrameWriter
+{
+public:
+
+    // The magic number at the start of every run-length encoded file
+    static const char MAGIC[8];
+
+    // 'inner' is the back-end that will write the encoded data, and is owned by this object
+    CRleWriter(CFrameWriter* inner, uint32_t frameSize);
+
+    void    open(std::string filename, uint64_t totalBytes);
+    void    write(const uint8_t* data, size_t length);
+    void    close();
+
+protected:
+
+    // Accepts one complete frame, either extending the current run or starting a new one
+    void    addFrame(const uint8_t* frame);
+
+    // Writes the current run (if there is one) to the inner back-end
+    void    flushRun();
+
+    // The back-end that writes the encoded data
+    std::unique_ptr<CFrameWriter> m_inner;
+
+    // The number of bytes in a frame
+    uint32_t    m_frameSize;
+
+    // The frame of the current run, and how many times it has been repeated so far
+    std::vector<uint8_t> m_runFrame;
+    uint32_t    m_runCount;
+
+    // A partial frame, left over from a call to write() that didn't end on a frame boundary
+    std::vector<uint8_t> m_partial;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CRleReader - Reads the frames of a run-length encoded file (see CRleWriter) from front to back.  The frame
+//              of each run is read from the file just once, and handed out as many times as it's repeated
+//----------------------------------------------------------------------------------------------------------
+class CRleReader
+{
+public:
+
+    CRleReader() {m_file = nullptr;}
+    ~CRleReader() {if (m_file) fclose(m_file);}
+
+    // Returns true if the file exists and is a run-length encoded file
+    static bool isRleFile(std::string filename);
+
+    // Opens a run-length encoded file and reads its header.  Can throw exception runtime_error
+    void        open(std::string filename);
+
+    // The shape of the file
+    uint32_t    frameSize()  const {return m_frameSize;}
+    uint64_t    frameCount() const {return m_frameCount;}
+
+    // Fetches the next 'count' frames.   Can throw exception runtime_error
+    void        read(uint64_t count, uint8_t* dst);
+
+protected:
+
+    std::string m_filename;
+    FILE*       m_file;
+    uint32_t    m_frameSize;
+    uint64_t    m_frameCount;
+
+    // The number of frames that have been handed out so far
+    uint64_t    m_framesRead;
+
+    // The frame of the current run, and how many more times it's to be handed out
+    std::vector<uint8_t> m_runFrame;
+    uint32_t    m_runLeft;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CDiscardWriter - An output back-end that throws its data away.  This lets frame building be timed by
+//                  itself
+//----------------------------------------------------------------------------------------------------------
+class CDiscardWriter : public CFrameWriter
+{
+public:
+
+    void    open(std::string, uint64_t) {}
+    void    write(const uint8_t*, size_t) {}
+    void    close() {}
+};
+//----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,282 @@
+//==========================================================================================================
+// lvds_reorder.cpp - Implements the kernels that re-order a row of cell data for transmission over LVDS
+//==========================================================================================================
+#include <string.h>
+#include <stdexcept>
+#include "lvds_reorder.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL
+#endif
+
+using namespace std;
+
+//==========================================================================================================
+// reorderTable() - The reference kernel: applies lvdsTranslationTable one cell at a time
+//==========================================================================================================
+static void reorderTable(const uint8_t* raw, uint8_t* lvds)
+{
+    for (int i=0; i<ROW_SIZE; ++i) lvds[i] = raw[lvdsTranslationTable[i]];
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// About the SIMD kernels
+//
+// Raw cell (quarter * 512) + (8 * i) + group lands at LVDS position (group * 256) + (quarter * 64) + 63 - i
+//
+// So each 64-byte block 'k' of a quarter contains eight 8-byte words w0..w7 (i = 8k .. 8k+7), each holding
+// one cell for each of the 8 groups.  Transposing that 8x8 byte matrix with the words fed in reverse order
+// (w7 first) yields, for each group, the 8 bytes that belong at LVDS position (group*256) + (quarter*64)
+// + 56 - 8k, already in ascending address order.
+//==========================================================================================================
+
+#ifdef HAVE_X86_KERNELS
+
+//==========================================================================================================
+// reorderSse2() - Kernel that transposes one 64-byte block per iteration using SSE2
+//==========================================================================================================
+static void reorderSse2(const uint8_t* raw, uint8_t* lvds)
+{
+    for (int quarter = 0; quarter < 4; ++quarter)
+    {
+        const uint8_t* in  = raw  + quarter * 512;
+        uint8_t*       out = lvds + quarter * 64;
+
+        for (int k = 0; k < 8; ++k, in += 64)
+        {
+            // Load the eight words of this block, two per register
+            __m128i x0 = _mm_loadu_si128((const __m128i*)(in +  0));     // w0, w1
+            __m128i x1 = _mm_loadu_si128((const __m128i*)(in + 16));     // w2, w3
+            __m128i x2 = _mm_loadu_si128((const __m128i*)(in + 32));     // w4, w5
+            __m128i x3 = _mm_loadu_si128((const __m128i*)(in + 48));     // w6, w7
+
+            // Interleave the bytes of each pair of words, higher-numbered word first
+            __m128i a0 = _mm_unpacklo_epi8(_mm_srli_si128(x3, 8), x3);   // w7, w6
+            __m128i a1 = _mm_unpacklo_epi8(_mm_srli_si128(x2, 8), x2);   // w5, w4
+            __m128i a2 = _mm_unpacklo_epi8(_mm_srli_si128(x1, 8), x1);   // w3, w2
+            __m128i a3 = _mm_unpacklo_epi8(_mm_srli_si128(x0, 8), x0);   // w1, w0
+
+            // Interleave those pairs into groups of four words
+            __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+            __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+            __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+            __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+
+            // And finally into columns.  Each register now holds the columns for two cell-groups
+            __m128i c0 = _mm_unpacklo_epi32(b0, b2);
+            __m128i c1 = _mm_unpackhi_epi32(b0, b2);
+            __m128i c2 = _mm_unpacklo_epi32(b1, b3);
+            __m128i c3 = _mm_unpackhi_epi32(b1, b3);
+
+            // Store each column where it belongs in the LVDS-ordered row
+            uint8_t* p = out + 56 - 8 * k;
+            _mm_storel_epi64((__m128i*)(p + 0 * 256), c0);
+            _mm_storel_epi64((__m128i*)(p + 1 * 256), _mm_srli_si128(c0, 8));
+            _mm_storel_epi64((__m128i*)(p + 2 * 256), c1);
+            _mm_storel_epi64((__m128i*)(p + 3 * 256), _mm_srli_si128(c1, 8));
+            _mm_storel_epi64((__m128i*)(p + 4 * 256), c2);
+            _mm_storel_epi64((__m128i*)(p + 5 * 256), _mm_srli_si128(c2, 8));
+            _mm_storel_epi64((__m128i*)(p + 6 * 256), c3);
+            _mm_storel_epi64((__m128i*)(p + 7 * 256), _mm_srli_si128(c3, 8));
+        }
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// reorderAvx2() - Kernel that transposes two 64-byte blocks per iteration using AVX2.   The lower lane
+//                 of each register works on block 'k', the upper lane on block 'k+1'
+//==========================================================================================================
+__attribute__((target("avx2")))
+static void reorderAvx2(const uint8_t* raw, uint8_t* lvds)
+{
+    for (int quarter = 0; quarter < 4; ++quarter)
+    {
+        const uint8_t* in  = raw  + quarter * 512;
+        uint8_t*       out = lvds + quarter * 64;
+
+        for (int k = 0; k < 8; k += 2, in += 128)
+        {
+            // Load both blocks
+            __m256i ya = _mm256_loadu_si256((const __m256i*)(in +  0));  // block k   : w0..w3
+            __m256i yb = _mm256_loadu_si256((const __m256i*)(in + 32));  // block k   : w4..w7
+            __m256i yc = _mm256_loadu_si256((const __m256i*)(in + 64));  // block k+1 : w0..w3
+            __m256i yd = _mm256_loadu_si256((const __m256i*)(in + 96));  // block k+1 : w4..w7
+
+            // Arrange them so that each register holds the same pair of words from both blocks
+            __m256i x0 = _mm256_permute2x128_si256(ya, yc, 0x20);        // w0, w1
+            __m256i x1 = _mm256_permute2x128_si256(ya, yc, 0x31);        // w2, w3
+            __m256i x2 = _mm256_permute2x128_si256(yb, yd, 0x20);        // w4, w5
+            __m256i x3 = _mm256_permute2x128_si256(yb, yd, 0x31);        // w6, w7
+
+            // From here on, this is the same transpose as the SSE2 kernel, on both lanes at once
+            __m256i a0 = _mm256_unpacklo_epi8(_mm256_srli_si256(x3, 8), x3);
+            __m256i a1 = _mm256_unpacklo_epi8(_mm256_srli_si256(x2, 8), x2);
+            __m256i a2 = _mm256_unpacklo_epi8(_mm256_srli_si256(x1, 8), x1);
+            __m256i a3 = _mm256_unpacklo_epi8(_mm256_srli_si256(x0, 8), x0);
+
+            __m256i b0 = _mm256_unpacklo_epi16(a0, a1);
+            __m256i b1 = _mm256_unpackhi_epi16(a0, a1);
+            __m256i b2 = _mm256_unpacklo_epi16(a2, a3);
+            __m256i b3 = _mm256_unpackhi_epi16(a2, a3);
+
+            __m256i c0 = _mm256_unpacklo_epi32(b0, b2);
+            __m256i c1 = _mm256_unpackhi_epi32(b0, b2);
+            __m256i c2 = _mm256_unpacklo_epi32(b1, b3);
+            __m256i c3 = _mm256_unpackhi_epi32(b1, b3);
+
+            // Block k+1's column for a cell-group belongs just before block k's column, so pair
+            // them up and store each cell-group's 16 bytes with a single store
+            c0 = _mm256_permute4x64_epi64(c0, _MM_SHUFFLE(1, 3, 0, 2));
+            c1 = _mm256_permute4x64_epi64(c1, _MM_SHUFFLE(1, 3, 0, 2));
+            c2 = _mm256_permute4x64_epi64(c2, _MM_SHUFFLE(1, 3, 0, 2));
+            c3 = _mm256_permute4x64_epi64(c3, _MM_SHUFFLE(1, 3, 0, 2));
+
+            uint8_t* p = out + 48 - 8 * k;
+            _mm_storeu_si128((__m128i*)(p + 0 * 256), _mm256_castsi256_si128(c0));
+            _mm_storeu_si128((__m128i*)(p + 1 * 256), _mm256_extracti128_si256(c0, 1));
+            _mm_storeu_si128((__m128i*)(p + 2 * 256), _mm256_castsi256_si128(c1));
+            _mm_storeu_si128((__m128i*)(p + 3 * 256), _mm256_extracti128_si256(c1, 1));
+            _mm_storeu_si128((__m128i*)(p + 4 * 256), _mm256_castsi256_si128(c2));
+            _mm_storeu_si128((__m128i*)(p + 5 * 256), _mm256_extracti128_si256(c2, 1));
+            _mm_storeu_si128((__m128i*)(p + 6 * 256), _mm256_castsi256_si128(c3));
+            _mm_storeu_si128((__m128i*)(p + 7 * 256), _mm256_extracti128_si256(c3, 1));
+        }
+    }
+}
+//==========================================================================================================
+
+#endif
+
+
+#ifdef HAVE_NEON_KERNEL
+
+//==========================================================================================================
+// reorderNeon() - Kernel that transposes one 64-byte block per iteration using NEON
+//==========================================================================================================
+static void reorderNeon(const uint8_t* raw, uint8_t* lvds)
+{
+    for (int quarter = 0; quarter < 4; ++quarter)
+    {
+        const uint8_t* in  = raw  + quarter * 512;
+        uint8_t*       out = lvds + quarter * 64;
+
+        for (int k = 0; k < 8; ++k, in += 64)
+        {
+            // Load the eight words of this block in reverse order
+            uint8x8_t r0 = vld1_u8(in + 56), r1 = vld1_u8(in + 48);
+            uint8x8_t r2 = vld1_u8(in + 40), r3 = vld1_u8(in + 32);
+            uint8x8_t r4 = vld1_u8(in + 24), r5 = vld1_u8(in + 16);
+            uint8x8_t r6 = vld1_u8(in +  8), r7 = vld1_u8(in +  0);
+
+            // Transpose the 8x8 matrix
+            uint8x8x2_t  b0 = vtrn_u8(r0, r1);
+            uint8x8x2_t  b1 = vtrn_u8(r2, r3);
+            uint8x8x2_t  b2 = vtrn_u8(r4, r5);
+            uint8x8x2_t  b3 = vtrn_u8(r6, r7);
+
+            uint16x4x2_t c0 = vtrn_u16(vreinterpret_u16_u8(b0.val[0]), vreinterpret_u16_u8(b1.val[0]));
+            uint16x4x2_t c1 = vtrn_u16(vreinterpret_u16_u8(b0.val[1]), vreinterpret_u16_u8(b1.val[1]));
+            uint16x4x2_t c2 = vtrn_u16(vreinterpret_u16_u8(b2.val[0]), vreinterpret_u16_u8(b3.val[0]));
+            uint16x4x2_t c3 = vtrn_u16(vreinterpret_u16_u8(b2.val[1]), vreinterpret_u16_u8(b3.val[1]));
+
+            uint32x2x2_t d0 = vtrn_u32(vreinterpret_u32_u16(c0.val[0]), vreinterpret_u32_u16(c2.val[0]));
+            uint32x2x2_t d1 = vtrn_u32(vreinterpret_u32_u16(c1.val[0]), vreinterpret_u32_u16(c3.val[0]));
+            uint32x2x2_t d2 = vtrn_u32(vreinterpret_u32_u16(c0.val[1]), vreinterpret_u32_u16(c2.val[1]));
+            uint32x2x2_t d3 = vtrn_u32(vreinterpret_u32_u16(c1.val[1]), vreinterpret_u32_u16(c3.val[1]));
+
+            // Store each column where it belongs in the LVDS-ordered row
+            uint8_t* p = out + 56 - 8 * k;
+            vst1_u8(p + 0 * 256, vreinterpret_u8_u32(d0.val[0]));
+            vst1_u8(p + 1 * 256, vreinterpret_u8_u32(d1.val[0]));
+            vst1_u8(p + 2 * 256, vreinterpret_u8_u32(d2.val[0]));
+            vst1_u8(p + 3 * 256, vreinterpret_u8_u32(d3.val[0]));
+            vst1_u8(p + 4 * 256, vreinterpret_u8_u32(d0.val[1]));
+            vst1_u8(p + 5 * 256, vreinterpret_u8_u32(d1.val[1]));
+            vst1_u8(p + 6 * 256, vreinterpret_u8_u32(d2.val[1]));
+            vst1_u8(p + 7 * 256, vreinterpret_u8_u32(d3.val[1]));
+        }
+    }
+}
+//==========================================================================================================
+
+#endif
+
+
+//==========================================================================================================
+// kernelIsCorrect() - Checks a kernel against the reference kernel
+//
+// Two test rows are used: one holding the low byte of each cell's position and one holding the high
+// byte, so between them every cell is uniquely identifiable
+//==========================================================================================================
+static bool kernelIsCorrect(lvdsKernel_t kernel)
+{
+    uint8_t raw[ROW_SIZE], expected[ROW_SIZE], actual[ROW_SIZE];
+
+    for (int shift = 0; shift <= 8; shift += 8)
+    {
+        for (int i=0; i<ROW_SIZE; ++i) raw[i] = (uint8_t)(i >> shift);
+        reorderTable(raw, expected);
+        kernel(raw, actual);
+        if (memcmp(expected, actual, ROW_SIZE) != 0) return false;
+    }
+
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// selectLvdsKernel() - Returns the kernel with the specified name
+//
+// Passed: name         = "table", "sse2", "avx2", "neon", or "auto"
+//         p_chosenName = If not null, receives the name of the kernel that was selected
+//==========================================================================================================
+lvdsKernel_t selectLvdsKernel(string name, string* p_chosenName)
+{
+    lvdsKernel_t kernel = nullptr;
+
+    // If the caller wants us to choose, pick the fastest kernel this CPU supports
+    if (name == "auto")
+    {
+        name = "table";
+        #ifdef HAVE_X86_KERNELS
+            name = __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+        #endif
+        #ifdef HAVE_NEON_KERNEL
+            name = "neon";
+        #endif
+    }
+
+    // Look up the kernel with this name
+    if (name == "table") kernel = reorderTable;
+
+    #ifdef HAVE_X86_KERNELS
+        if (name == "sse2") kernel = reorderSse2;
+        if (name == "avx2" && __builtin_cpu_supports("avx2")) kernel = reorderAvx2;
+    #endif
+
+    #ifdef HAVE_NEON_KERNEL
+        if (name == "neon") kernel = reorderNeon;
+    #endif
+
+    // If there's no such kernel on this machine, complain
+    if (kernel == nullptr) throw runtime_error("LVDS kernel '" + name + "' isn't available on this CPU");
+
+    // Make sure the kernel produces the same result as the reference kernel
+    if (!kernelIsCorrect(kernel)) throw runtime_error("BUG: LVDS kernel '" + name + "' is incorrect");
+
+    // Tell the caller which kernel was chosen and hand it to them
+    if (p_chosenName) *p_chosenName = name;
+    return kernel;
+}
+//==========================================================================================================
@@ -0,0 +1,117 @@
+//==========================================================================================================
+// lvds_reorder.h - Defines the kernels that re-order a row of cell data for transmission over ECD LVDS
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <array>
+
+// This is the number of cells in a single data row on the chip
+const int ROW_SIZE = 2048;
+
+// A table that maps one position within a row to another
+typedef std::array<uint16_t, ROW_SIZE> rowMap_t;
+
+//----------------------------------------------------------------------------------------------------------
+// makeLvdsTranslationTable() - Computes (at compile time) the table that re-arranges a row of data so
+//                              that it's in suitable order for transmission over ECD LVDS
+//
+// The value 'x' at index 'i' means: lvds_order[i] = raw_order[x]
+//----------------------------------------------------------------------------------------------------------
+constexpr rowMap_t makeLvdsTranslationTable()
+{
+    rowMap_t table {};
+
+    // Each row of a frame consists of 2048 cells divided into 8 cell-groups
+    for (int group = 0; group <8; ++group)
+    {
+        // Determine the offset (within a row) of the first cell in this group
+        int groupOffset = group * 256 + 63;
+
+        // Each group consists of four rows of 64-cells each
+        for (int row=0; row < 4; ++row)
+        {
+            int rowOffset = groupOffset + (row * 64);
+            int cellValue = row * 512 + group;
+
+            for (int i=0; i<64; ++i)
+            {
+                table[rowOffset - i] = cellValue;
+                cellValue = cellValue + 8;
+            }
+        }
+    }
+
+    return table;
+}
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// invertRowMap() - Computes the inverse of a row map.   For the LVDS translation table, the value 'x' at
+//                  index 'i' of the inverse means: lvds_order[x] = raw_order[i]
+//----------------------------------------------------------------------------------------------------------
+constexpr rowMap_t invertRowMap(const rowMap_t& map)
+{
+    rowMap_t inverse {};
+    for (int i=0; i<ROW_SIZE; ++i) inverse[map[i]] = i;
+    return inverse;
+}
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// isPermutation() - Returns true if every position in a row appears in the map exactly once
+//----------------------------------------------------------------------------------------------------------
+constexpr bool isPermutation(const rowMap_t& map)
+{
+    bool seen[ROW_SIZE] {};
+    for (int i=0; i<ROW_SIZE; ++i)
+    {
+        if (map[i] >= ROW_SIZE || seen[map[i]]) return false;
+        seen[map[i]] = true;
+    }
+    return true;
+}
+//----------------------------------------------------------------------------------------------------------
+
+
+// For each position in an LVDS-ordered row, the position in the raw row that it comes from
+constexpr rowMap_t lvdsTranslationTable = makeLvdsTranslationTable();
+
+// For each position in a raw row, the position in the LVDS-ordered row that it goes to
+constexpr rowMap_t lvdsPositionTable = invertRowMap(lvdsTranslationTable);
+
+static_assert(isPermutation(lvdsTranslationTable), "The LVDS translation table must be a permutation");
+
+
+//----------------------------------------------------------------------------------------------------------
+// cellPosition() - Returns the position within a frame where a cell's value is stored.   The "true"
+//                  specialization is for LVDS-ordered frames, the "false" specialization is the identity
+//----------------------------------------------------------------------------------------------------------
+template <bool LVDS> inline uint32_t cellPosition(uint32_t cellIndex)
+{
+    if constexpr (LVDS)
+        return (cellIndex & ~(ROW_SIZE - 1)) | lvdsPositionTable[cellIndex & (ROW_SIZE - 1)];
+    else
+        return cellIndex;
+}
+//----------------------------------------------------------------------------------------------------------
+
+
+//----------------------------------------------------------------------------------------------------------
+// A kernel translates one row of cells from raw order into LVDS order.  'raw' and 'lvds' must not overlap.
+//
+// Frames can instead be built directly in LVDS order via cellPosition<true>(), which needs no kernel.
+//
+// The "table" kernel is the reference implementation, and simply applies lvdsTranslationTable.  Every other
+// kernel hard-codes the structure of the LVDS map: within each 512-cell quarter of a row, the cells are an
+// 8-column matrix (one column per cell-group) that gets transposed, with each column then reversed.
+//----------------------------------------------------------------------------------------------------------
+typedef void (*lvdsKernel_t)(const uint8_t* raw, uint8_t* lvds);
+
+// Call this to fetch a kernel by name: "table", "sse2", "avx2", "neon", or "auto" for the fastest one
+// this CPU supports.   The kernel is checked against the reference kernel before being returned.
+// Can throw exception runtime_error
+lvdsKernel_t selectLvdsKernel(std::string name, std::string* p_chosenName = nullptr);
+//----------------------------------------------------------------------------------------------------------
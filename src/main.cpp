@@ -11,8 +11,89 @@
 //
 //   -lvdsmap              : display the lvds reording map, then exit
 //
-//   -trace <cell_number>  : instead of creating an output file, traces a cell in an existing 
-//                           file.
+//   -trace <cell_list>    : instead of creating an output file, traces cells in an existing 
+//                           file.  <cell_list> is a comma-separated list of cell numbers and
+//                           ranges, such as "7" or "1,5,10-20", or "@<filename>" to read the
+//                           list from a file
+//
+//   -export <filename>    : used with -trace, writes the traced cells to <filename> instead of
+//                           displaying them.  If <filename> ends in ".csv" it's a CSV matrix
+//                           with one row per frame and one column per cell.  Otherwise it's
+//                           binary and columnar: each cell's value from every frame, cell after
+//                           cell
+//
+//   -delta                : build each data frame by applying only the changes from the
+//                           previous frame, rather than rebuilding it from scratch
+//
+//   -expand <filename>    : instead of creating an output file, expands an existing run-length
+//                           encoded or chunked output file into an ordinary one named <filename>
+//
+//   -lvdskernel <name>    : selects how LVDS re-ordering is performed: "fused" (the default)
+//                           builds frames directly in LVDS order.  Otherwise, frames are built
+//                           in raw order and then re-ordered by "table" (the reference
+//                           implementation), "sse2", "avx2", "neon", or "auto", which picks the
+//                           fastest of those that this CPU supports
+//
+//   -update               : instead of creating the output file, updates the existing one so
+//                           that it matches the current distribution file, by rewriting only
+//                           the cells that are affected by records that have changed.  The
+//                           distribution an output file was built from is kept alongside it,
+//                           in <output_file>.dist
+//
+//   -shard <i>/<n>        : divides the output file's frame groups into <n> shards of (nearly)
+//                           equal size, and writes only shard <i> (numbered from 0) to the
+//                           file <output_file>.shard<i>of<n>.  <output_file>.manifest lists
+//                           how the shards are concatenated to form the whole output file
+//
+//   -bench <records>      : instead of creating an output file, times each stage of frame
+//                           generation (parsing, frame building, LVDS re-ordering, and each
+//                           output back-end) over a synthetic distribution with <records>
+//                           records, and reports the throughput of each
+//
+//   -synth <records>      : instead of creating an output file, writes a synthetic
+//                           fragment_file and distribution_file with <records> records that
+//                           are spread across cells_per_frame cells, and whose sequences are
+//                           long enough to fill contig_size.  Any existing files by those names
+//                           are overwritten.  See scaling.sh
+//
+//   -serve <path>         : instead of creating an output file, listens on the UNIX-domain
+//                           socket <path> and sends clients whichever ranges of frames they
+//                           ask for, building them on demand.  Recently requested frames are
+//                           cached (see "frame_cache_size").  The protocol is described in
+//                           frame_server.h
+//
+//   -verify               : instead of creating an output file, rebuilds every frame and checks
+//                           that an existing output file matches, frame group by frame group,
+//                           on -threads threads.  If the output file can't be read back (for
+//                           instance, it's run-length encoded or it was written to the contig
+//                           buffer), the rebuilt frames are checked against the CRC32C of each
+//                           frame group in <output_file>.crc instead, which is written when
+//                           "checksums" is true
+//
+//   -batch <filename>     : instead of creating a single output file, creates the output file
+//                           of every job in the batch manifest <filename>.  The fragment and
+//                           distribution files are loaded once, and the jobs (each with its own
+//                           data_frames, diagnostic_values, quiescent and output settings) are
+//                           run concurrently on -threads threads.  See batch_manifest.conf
+//
+//   -stats <filename>     : while the output file is being written, append a line of JSON
+//                           to <filename> describing the progress, throughput, and the time
+//                           spent on I/O versus compute at every progress report, plus a
+//                           final line once the output file is complete
+//
+//   -threads <count>      : build frames on a pool of <count> worker threads while the main
+//                           thread writes them to the output file in order.  When the output
+//                           file is memory-mapped, each thread fills its own range of frames.
+//                           Large input files are also parsed on <count> threads
+//
+//   -numa                 : pin each frame-building worker thread to the CPUs of one NUMA node
+//                           (workers are dealt out round-robin across the nodes), and build its
+//                           frames in buffers allocated from that node's memory
+//
+//   -hugepages <size>     : allocate frame-building buffers from huge pages.  <size> is "2M" or
+//                           "1G" for pages from the kernel's huge page pool, or "thp" for
+//                           transparent huge pages.  If the pool is empty, transparent huge
+//                           pages are used instead
 //                        
 //=================================================================================================
 
@@ -21,6 +102,9 @@
 #include <stdlib.h>
 #include <exception>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <cstdarg>
 #include <cstring>
 #include <iostream>
@@ -28,42 +112,64 @@
 #include <map>
 #include <vector>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <chrono>
 #include "config_file.h"
+#include "frame_writer.h"
+#include "lvds_reorder.h"
+#include "progress_monitor.h"
+#include "frame_generator.h"
+#include "frame_server.h"
+#include "frame_checksum.h"
+#include "chunked_file.h"
+#include "numa_placement.h"
+#include "uring_writer.h"
 
 using namespace std;
- 
+
 void     execute(const char** argv);
-void     loadFragments();
-void     loadDistribution();
-uint32_t findLongestSequence();
+generatorOptions_t generatorOptions();
 uint32_t verifyDistributionIsValid();
+void     reportOverlaps();
 void     writeOutputFile(uint32_t frameGroupCount);
+void     updateOutputFile(uint32_t frameGroupCount);
+void     saveOutputRecord(const config_t& settings, const CFrameGenerator& builder);
+bool     isUpdatableOutput(const config_t& settings);
+void     writeFrames(CFrameWriter* writer, uint32_t firstGroup, uint32_t endGroup);
+void     writeFramesThreaded(CFrameWriter* writer, uint64_t firstFrame, uint64_t endFrame);
+void     writeFramesMapped(uint8_t* base, uint64_t firstFrame, uint64_t endFrame);
+void     writeShardManifest(uint32_t frameGroupCount);
+string   shardFileName(uint32_t index);
+void     expandRleFile(string filename);
+void     expandChunkedFile(string filename);
+CFrameWriter* openFrameWriter(string target, uint64_t totalBytes, const config_t& settings);
 void     parseCommandLine(const char** argv);
-void     trace(uint32_t cellNumber);
-void     readConfigurationFile(string filename);
-void     createLvdsTranslationTable();
-void     reorderForLvds(uint8_t* frame);
+void     trace(const vector<uint32_t>& cellList);
+void     exportTrace(const vector<uint32_t>& cellList, string filename);
+vector<uint32_t> traceOffsets(const vector<uint32_t>& cellList);
+vector<uint32_t> parseCellList(string text);
 void     printLvdsMap();
+void     runBenchmark(uint32_t recordCount);
+void     writeSyntheticWorkload(uint32_t recordCount);
+void     verifyOutputFile(uint32_t frameGroupCount);
+void     runBatch(string manifest);
+void     writeBatchJob(const config_t& settings, const CFrameGenerator& jobGenerator);
 
-// Define a convenient type to encapsulate a vector of strings
-typedef vector<string> strvec_t;
+// The generator that builds every frame of the output file
+unique_ptr<CFrameGenerator> generator;
 
-// Contains nucleic acid fragement definitions
-map<string, vector<int>> fragment;
+// Keeps track of (and periodically reports) how far along we are in writing the output file
+CProgressMonitor progress;
 
-// This list defines each fragment distribution in the distribution definitions file
-struct distribution_t
-{
-    int             first, last, step;
-    vector<uint8_t> cellValue;
-};
-vector<distribution_t> distributionList;
-
-// This is the number of cells in a single data row on the chip
-const int ROW_SIZE = 2048;
+// Decides which NUMA node each worker thread runs on, and what kind of pages frames are built in
+CNumaPlacement placement;
 
-// This translates cell positions within a row so that they are suitable for LVDS
-int lvdsTranslationTable[ROW_SIZE];
 
 //=================================================================================================
 // Command line options
@@ -71,29 +177,34 @@ int lvdsTranslationTable[ROW_SIZE];
 struct cmdline_t
 {
     bool     trace;
-    uint32_t cellNumber;
+    string   cellList;
+    string   exportFile;
     string   config;
     bool     nolvds;
     bool     lvdsmap;
+    bool     delta;
+    bool     update;
+    bool     verify;
+    uint32_t shardIndex, shardCount;
+    uint32_t benchRecords;
+    uint32_t synthRecords;
+    string   statsFile;
+    string   servePath;
+    string   batchFile;
+    bool     expand;
+    string   expandFile;
+    string   lvdsKernel = "fused";
+    uint32_t threads;
+    bool     numa;
+    string   hugePages = "none";
 } cmdLine;
 //=================================================================================================
 
 
 //=================================================================================================
-// Variable names in this structure should exactly match the configuration file
+// The settings from the configuration file
 //=================================================================================================
-struct config_t
-{
-    uint32_t         cells_per_frame;
-    uint64_t         contig_size;
-    vector<uint8_t>  diagnostic_values;
-    uint32_t         data_frames;
-    uint8_t          quiescent;
-    string           fragment_file;
-    string           distribution_file;
-    string           output_file;
-
-} config;
+config_t config;
 //=================================================================================================
 
 
@@ -150,12 +261,22 @@ void parseCommandLine(const char** argv)
         {
             cmdLine.trace = true;
             if (argv[i+1])
-                cmdLine.cellNumber = atoi(argv[++i]);                
+                cmdLine.cellList = argv[++i];
             else
                 throwRuntime("Missing parameter on -trace");                
             continue;
         }
 
+        // Handle the "-export" command line switch
+        if (token == "-export")
+        {
+            if (argv[i+1])
+                cmdLine.exportFile = argv[++i];
+            else
+                throwRuntime("Missing parameter on -export");
+            continue;
+        }
+
         // Handle the "-config" command line switch
         if (token == "-config")
         {
@@ -173,6 +294,112 @@ void parseCommandLine(const char** argv)
             continue;
         }
 
+        // Handle the "-expand" command line switch
+        if (token == "-expand")
+        {
+            cmdLine.expand = true;
+            if (argv[i+1])
+                cmdLine.expandFile = argv[++i];
+            else
+                throwRuntime("Missing parameter on -expand");
+            continue;
+        }
+
+        // Handle the "-lvdskernel" command line switch
+        if (token == "-lvdskernel")
+        {
+            if (argv[i+1])
+                cmdLine.lvdsKernel = argv[++i];
+            else
+                throwRuntime("Missing parameter on -lvdskernel");
+            continue;
+        }
+
+        // Handle the "-update" command line switch
+        if (token == "-update")
+        {
+            cmdLine.update = true;
+            continue;
+        }
+
+        // Handle the "-shard" command line switch
+        if (token == "-shard")
+        {
+            if (argv[i+1] == nullptr) throwRuntime("Missing parameter on -shard");
+            if (sscanf(argv[++i], "%u/%u", &cmdLine.shardIndex, &cmdLine.shardCount) != 2
+            ||  cmdLine.shardCount == 0 || cmdLine.shardIndex >= cmdLine.shardCount)
+            {
+                throwRuntime("Invalid -shard '%s', expected <index>/<count>", argv[i]);
+            }
+            continue;
+        }
+
+        // Handle the "-bench" command line switch
+        if (token == "-bench")
+        {
+            if (argv[i+1])
+                cmdLine.benchRecords = atoi(argv[++i]);
+            else
+                throwRuntime("Missing parameter on -bench");
+            if (cmdLine.benchRecords == 0) throwRuntime("Invalid parameter on -bench");
+            continue;
+        }
+
+        // Handle the "-synth" command line switch
+        if (token == "-synth")
+        {
+            if (argv[i+1])
+                cmdLine.synthRecords = atoi(argv[++i]);
+            else
+                throwRuntime("Missing parameter on -synth");
+            if (cmdLine.synthRecords == 0) throwRuntime("Invalid parameter on -synth");
+            continue;
+        }
+
+        // Handle the "-serve" command line switch
+        if (token == "-serve")
+        {
+            if (argv[i+1])
+                cmdLine.servePath = argv[++i];
+            else
+                throwRuntime("Missing parameter on -serve");
+            continue;
+        }
+
+        // Handle the "-verify" command line switch
+        if (token == "-verify")
+        {
+            cmdLine.verify = true;
+            continue;
+        }
+
+        // Handle the "-batch" command line switch
+        if (token == "-batch")
+        {
+            if (argv[i+1])
+                cmdLine.batchFile = argv[++i];
+            else
+                throwRuntime("Missing parameter on -batch");
+            continue;
+        }
+
+        // Handle the "-stats" command line switch
+        if (token == "-stats")
+        {
+            if (argv[i+1])
+                cmdLine.statsFile = argv[++i];
+            else
+                throwRuntime("Missing parameter on -stats");
+            continue;
+        }
+
+        // Handle the "-delta" command line switch
+        if (token == "-delta")
+        {
+            cmdLine.delta = true;
+            continue;
+        }
+
         // Handle the "-lvdsmap" command line switch
         if (token == "-lvdsmap")
         {
@@ -180,6 +407,33 @@ void parseCommandLine(const char** argv)
             continue;
         }
 
+        // Handle the "-threads" command line switch
+        if (token == "-threads")
+        {
+            if (argv[i+1])
+                cmdLine.threads = atoi(argv[++i]);
+            else
+                throwRuntime("Missing parameter on -threads");
+            continue;
+        }
+
+        // Handle the "-numa" command line switch
+        if (token == "-numa")
+        {
+            cmdLine.numa = true;
+            continue;
+        }
+
+        // Handle the "-hugepages" command line switch
+        if (token == "-hugepages")
+        {
+            if (argv[i+1])
+                cmdLine.hugePages = argv[++i];
+            else
+                throwRuntime("Missing parameter on -hugepages");
+            continue;
+        }
+
         printf("Illegal command line parameter '%s'\n", token.c_str());
         exit(1);
     }
@@ -201,11 +455,16 @@ void execute(const char** argv)
     parseCommandLine(argv);
 
     // Fetch the configuration values from the file and populate the global "config" structure
-    readConfigurationFile(cmdLine.config);
+    readConfigurationFile(cmdLine.config, config);
 
-    // Create the translation table that re-orders cell data within all rows of a frame so that
-    // it's in the proper order for LVDS transmission from the ECD to the FPGA
-    createLvdsTranslationTable();
+    // Find out how worker threads and their buffers are to be placed
+    placement.init(cmdLine.numa, parseHugePages(cmdLine.hugePages));
+
+    // If the output is being streamed to stdout, keep everything we display out of the stream
+    if (config.output_file == "-" && !cmdLine.trace && !cmdLine.expand && !cmdLine.lvdsmap)
+    {
+        CStreamWriter::reserveStdout();
+    }
 
     // If the user wants to display the LVDS re-ordering map, make it so
     if (cmdLine.lvdsmap)
@@ -214,24 +473,98 @@ void execute(const char** argv)
         exit(0);
     }
 
-    // If we're supposed to trace a single cell, make it so
+    // If we're supposed to trace cells, make it so
     if (cmdLine.trace)
     {
-        trace(cmdLine.cellNumber);
+        if (cmdLine.exportFile.empty())
+            trace(parseCellList(cmdLine.cellList));
+        else
+            exportTrace(parseCellList(cmdLine.cellList), cmdLine.exportFile);
+        exit(0);
+    }
+
+    // If we're supposed to expand a run-length encoded or chunked file, make it so
+    if (cmdLine.expand)
+    {
+        if (CChunkedReader::isChunkedFile(config.output_file))
+            expandChunkedFile(cmdLine.expandFile);
+        else
+            expandRleFile(cmdLine.expandFile);
+        exit(0);
+    }
+
+    // If we're supposed to run the benchmarks, make it so
+    if (cmdLine.benchRecords)
+    {
+        runBenchmark(cmdLine.benchRecords);
+        exit(0);
+    }
+
+    // If we're supposed to write a synthetic workload, make it so
+    if (cmdLine.synthRecords)
+    {
+        writeSyntheticWorkload(cmdLine.synthRecords);
         exit(0);
     }
 
-    // Load the fragment definitions
-    loadFragments();
+    // If we're supposed to run a batch of jobs, make it so
+    if (!cmdLine.batchFile.empty())
+    {
+        runBatch(cmdLine.batchFile);
+        return;
+    }
 
-    // Load the fragment sequence distribution definitions
-    loadDistribution();
+    // Create the frame generator, and have it load (or compile) the distribution
+    generator.reset(new CFrameGenerator(config, generatorOptions()));
+    generator->load();
 
     // Find out how many frame groups we need to write to the output file
     uint32_t frameGroupCount = verifyDistributionIsValid();
 
-    // Write the output file
+    // If we're supposed to serve frames on demand, make it so
+    if (!cmdLine.servePath.empty())
+    {
+        CFrameServer server(*generator, config.frame_cache_size);
+        server.run(cmdLine.servePath);
+        return;
+    }
+
+    // If we're supposed to verify an existing output file, make it so
+    if (cmdLine.verify)
+    {
+        if (cmdLine.shardCount) throwRuntime("-verify can't be used with -shard");
+        verifyOutputFile(frameGroupCount);
+        return;
+    }
+
+    // If we're supposed to update an existing output file, make it so
+    if (cmdLine.update)
+    {
+        if (cmdLine.shardCount) throwRuntime("-update can't be used with -shard");
+        updateOutputFile(frameGroupCount);
+        return;
+    }
+
+    // Write the output file, and keep a record of the distribution it was built from.  A shard
+    // is just part of an output file, so it can't be updated
     writeOutputFile(frameGroupCount);
+    if (cmdLine.shardCount == 0) saveOutputRecord(config, *generator);
+}
+//=================================================================================================
+
+
+
+//=================================================================================================
+// generatorOptions() - Returns the frame generator options that the command line asks for
+//=================================================================================================
+generatorOptions_t generatorOptions()
+{
+    generatorOptions_t options;
+    options.lvds       = !cmdLine.nolvds;
+    options.delta      = cmdLine.delta;
+    options.lvdsKernel = cmdLine.lvdsKernel;
+    options.threads    = max(1U, cmdLine.threads);
+    return options;
 }
 //=================================================================================================
 
@@ -278,226 +611,36 @@ bool getNextCommaSeparatedToken(const char*& p, char* token)
 
 
 //=================================================================================================
-// getNextCommaSeparatedInt() - Similar to "getNextCommaSeparatedToken()", but converts the token
-//                              to an integer
-//=================================================================================================
-bool getNextCommaSeparatedInt(const char*& p, int* pValue)
-{
-    char token[1000];
-
-    // Fetch the next token
-    bool status = getNextCommaSeparatedToken(p, token);    
-
-    // Convert that token to an integer
-    *pValue = atoi(token);
-
-    // And tell the caller whether or not there was a token available
-    return status;
-}
-//=================================================================================================
-
-
-//=================================================================================================
-// loadFragments() - Load fragment definitions into RAM
-//
-// On Exit: the global "fragment" object contains fragment definitions
+// reportOverlaps() - Warns the user about distribution records that populate cells that a later
+//                    record also populates.  While both records have data, the later record wins
 //=================================================================================================
-void loadFragments()
+void reportOverlaps()
 {
-    char fragmentName[1000], buffer[1000];
-    vector<int> v;
-    string line;
-
-    // Fetch the filename of the fragment definiton file
-    const char* filename = config.fragment_file.c_str();
-
-    // Open the input file
-    ifstream file(filename);   
-
-    // If we can't open the input file, complain
-    if (!file.is_open()) throwRuntime("%s not found", filename);
-
-    // Loop through each line of the input file
-    while (getline(file, line))
-    {
-        // Get a pointer to the line of text we just read
-        const char* p = line.c_str();
-
-        // Skip over whitespace
-        while (*p == 32 || *p == 9) ++p;
-
-        // If the line is blank, skip it
-        if (*p == 0 || *p == 10 || *p == 13) continue;
-
-        // Any line starting with '#' is a comment
-        if (*p == '#') continue;
-
-        // Any line starting with '//' is a comment
-        if (p[0] == '/' && p[1] == '/') continue;
-
-        // Clear the fragment value vector
-        v.clear();
-
-        // Fetch the fragment name
-        getNextCommaSeparatedToken(p, fragmentName);
-
-        // If the fragment name is blank, skip this line
-        if (fragmentName[0] == 0) continue;
-
-        // Fetch every integer value after the name
-        while (getNextCommaSeparatedToken(p, buffer))
-        {
-            v.push_back(atoi(buffer));
-        }
-
-        // Save this fragment data into our global variable
-        fragment[fragmentName] = v;
-    }
-}
-//=================================================================================================
-
+    // Don't bury everything else under warnings
+    const size_t maxWarnings = 10;
 
+    auto& overlaps = generator->overlaps();
+    auto& list     = generator->distributionList();
 
+    if (overlaps.empty()) return;
+    printf("\n");
 
-//=================================================================================================
-// dumpDistributionList() - Displays the distribution list for debugging purposes
-//=================================================================================================
-void dumpDistributionList()
-{
-    for (auto& r : distributionList)
+    for (size_t i=0; i<overlaps.size() && i<maxWarnings; ++i)
     {
-        printf("%i : %i : %i  *** ", r.first, r.last, r.step);
-        for (auto i : r.cellValue) printf("%d  ", i);
-        printf("\n");
-
+        const overlap_t&      ov = overlaps[i];
+        const distribution_t& dr = list[ov.record];
+        printf("Warning: distribution record %u (cells %d-%d, step %d) is overridden by record %u in %'u of its %'u cells\n",
+               ov.record + 1, dr.first, dr.last, dr.step, ov.overriddenBy + 1, ov.overridden, ov.cells);
     }
-}
-//=================================================================================================
 
-
-
-//=================================================================================================
-// loadDistribution() - Loads the fragment distribution definitions into RAM
-//
-// On Exit: the global "distribuitionList" object contains distribution definitions
-//=================================================================================================
-void loadDistribution()
-{
-    char fragmentName[1000];
-    distribution_t distRecord;
-    string line;
-
-    // Get a handy reference to the vector of cell values in a distribution record
-    auto& drcv = distRecord.cellValue;
-
-    // Fetch the filename of the fragment distribiution definiton file
-    const char* filename = config.distribution_file.c_str();
-
-    // Open the input file
-    ifstream file(filename);   
-
-    // If we can't open the input file, complain
-    if (!file.is_open()) throwRuntime("%s not found", filename);
-
-     // Loop through each line of the input file
-    while (getline(file, line))
+    if (overlaps.size() > maxWarnings)
     {
-        // Get a pointer to the line of text we just read
-        const char* p = line.c_str();
-
-        // Skip over whitespace
-        while (*p == 32 || *p == 9) ++p;
-
-        // If the line is blank, skip it
-        if (*p == 0 || *p == 10 || *p == 13) continue;
-
-        // Any line starting with '#' is a comment
-        if (*p == '#') continue;
-
-        // Any line starting with '//' is a comment
-        if (p[0] == '/' && p[1] == '/') continue;
-
-        // Look for the '$' delimeter that begins a list of fragment IDs
-        const char* delimeter = strchr((char*)p, '$');
-
-        // If that delimeter doesn't exist, this isn't a valid distribution definition
-        if (delimeter == nullptr) continue;
-
-        // Replace the '$' with a carriage return to fake an "end of line"
-        *(char*)delimeter++ = 13;
-
-        // Just in case the user added a comma after the '$', consume it 
-        while (*delimeter == 32 || *delimeter == 9) ++delimeter;
-        if (*delimeter == ',') ++delimeter;
-
-        // Get the first cell number, the last cell number, and the step-size
-        getNextCommaSeparatedInt(p, &distRecord.first);
-        getNextCommaSeparatedInt(p, &distRecord.last );
-        getNextCommaSeparatedInt(p, &distRecord.step );
-
-        // Ensure that the first cell number in the distribution is valid
-        if (distRecord.first < 1 || distRecord.first > config.cells_per_frame)
-        {
-            throwRuntime("Invalid cell number %i", distRecord.first);
-        }
-
-        // If no "last cell" was specified, this distribution is just for the first cell
-        if (distRecord.last == 0) distRecord.last = distRecord.first;
-
-        // If no 'step' is specified, we're defining every cell from 'first' to 'last'
-        if (distRecord.step == 0) distRecord.step = 1;
-
-        // Clear the vector that will hold fragment data values
-        drcv.clear();
-
-        // Point to the comma separated fragement ids that come after the '$' delimeter
-        p = delimeter;
-
-        // Loop through every fragment name in the comma separated list...
-        while (getNextCommaSeparatedToken(p, fragmentName))
-        {
-            // If we don't recognize this fragment name, complain
-            if (fragment.find(fragmentName) == fragment.end())
-            {
-                throwRuntime("Undefined fragment name '%s'", fragmentName);
-            }
-
-            // Get a reference to the cell values for this fragment
-            auto& fragcv = fragment[fragmentName];
-
-            // Append the cell values for this fragment to the distribution record
-            drcv.insert(drcv.end(), fragcv.begin(), fragcv.end());
-        }
-
-        // And add this distribution record to the distribution list
-        distributionList.push_back(distRecord);
+        printf("Warning: %'lu more distribution records are overridden by later records\n", overlaps.size() - maxWarnings);
     }
 }
 //=================================================================================================
 
 
-//=================================================================================================
-// findLongestSequence() - Finds and returns the number of frames requires by the longest sequence
-//                         in the distributionList
-//=================================================================================================
-uint32_t findLongestSequence()
-{
-    uint32_t longestLength = 0;
-
-    // Loop through every record in the distribution list and keep
-    // track of the length of the longest sequence of fragments we find    
-    for (auto& distRec : distributionList)
-    {
-        // Keep track of the length of the longest sequence of fragments we find
-        if (distRec.cellValue.size() > longestLength) longestLength = distRec.cellValue.size();
-    };
-
-    // Hand the caller the length of the longest sequence of fragments
-    return longestLength;
-}
-//=================================================================================================
-
-
 //=================================================================================================
 // verifyDistributionIsValid() - Checks to make sure that number of frame groups implied by the
 //                               longest fragement sequence will fit into the contiguous buffer.
@@ -509,24 +652,17 @@ uint32_t verifyDistributionIsValid()
     // How many diagnostic frames are there?
     uint32_t diagnosticFrames = config.diagnostic_values.size();
 
-    // Ensure that the number of cells in a single frame is a multiple of the row size
-    if (config.cells_per_frame % ROW_SIZE != 0)
-    {
-        printf("\nConfig value 'cells_per_frame' must a multiple of %i\n", ROW_SIZE);
-        exit(1);        
-    }
-
     // What's the maximum number of frames that will fit into the contig buffer?
     uint32_t maxFrames = config.contig_size / config.cells_per_frame;
 
     // What is the maximum number of frames required by any fragment sequence?
-    uint32_t longestSequence = findLongestSequence();
+    uint32_t longestSequence = generator->longestSequence();
 
     // A "frame group" is a set of diagnostic frames followed by a set of data frames.
     uint32_t frameGroupLength = diagnosticFrames + config.data_frames;
 
     // How many frames groups are required to express our longest sequence?
-    uint32_t frameGroupCount = longestSequence / config.data_frames + 1;
+    uint32_t frameGroupCount = generator->frameGroupCount();
 
     // How many data frames are in 'frameGroupCount' frameg groups?
     uint32_t totalReqdFrames = frameGroupCount * frameGroupLength;
@@ -542,6 +678,9 @@ uint32_t verifyDistributionIsValid()
     printf("%'16u Frames required in total\n", totalReqdFrames);
     printf("%'16lu Bytes required in total\n", totalContigReqd);
 
+    // Warn the user about records that populate the same cells
+    reportOverlaps();
+
     // If the longest fragment sequence is too long to fit into the contiguous buffer,
     // complain and drop dead
     if (totalReqdFrames > maxFrames)
@@ -557,249 +696,1605 @@ uint32_t verifyDistributionIsValid()
 
 
 //=================================================================================================
-// buildDataFrame() - Uses the fragment-sequence distribution list to create a data frame
+// writeOutputFile() - Creates the output file
+//
+// Passed: frameGroupCount = The number of frame groups to write to the output file
 //=================================================================================================
-void buildDataFrame(uint8_t* frame, uint32_t frameNumber)
+void writeOutputFile(uint32_t frameGroupCount)
 {
-    // Every cell in the frame starts out quiescient
-    memset(frame, config.quiescent, config.cells_per_frame);
+    // How many frames are in a frame group?
+    uint32_t frameGroupLength = config.diagnostic_values.size() + config.data_frames;
 
-    // Loop through every distribution record in the distribution list
-    for (auto& dr : distributionList)
+    // Normally we write every frame group to the output file
+    uint32_t firstGroup = 0, endGroup = frameGroupCount;
+    string   target     = config.output_file;
+
+    // But if we're writing a shard, we write only its share of the frame groups to a file of its own
+    if (cmdLine.shardCount)
     {
-        // If this fragment sequence contains a value for this frame number...
-        if (frameNumber < dr.cellValue.size())
+        if (config.output_format != "raw" || config.output_mode == "contig")
         {
-            // Populate the appropriate cells with the data value for this frame
-            for (uint32_t cellNumber = dr.first-1; cellNumber < dr.last; cellNumber += dr.step)
-            {
-                frame[cellNumber] = dr.cellValue[frameNumber];
-            }
+            throwRuntime("-shard requires output_format 'raw' and can't be used with output_mode 'contig'");
+        }
+        firstGroup = (uint64_t)frameGroupCount *  cmdLine.shardIndex      / cmdLine.shardCount;
+        endGroup   = (uint64_t)frameGroupCount * (cmdLine.shardIndex + 1) / cmdLine.shardCount;
+        if (!CStreamWriter::isStreamTarget(target)) 
+        {
+            target = shardFileName(cmdLine.shardIndex);
+            writeShardManifest(frameGroupCount);
         }
+        printf("Writing frame groups %u thru %u of %u to %s\n", firstGroup, endGroup - 1, frameGroupCount, target.c_str());
     }
-}
-//=================================================================================================
-
 
-//=================================================================================================
-// writeOutputFile() - Creates the output file
-//=================================================================================================
-void writeOutputFile(uint32_t frameGroupCount)
-{
-    uint32_t i, frameNumber = 0;
+    // These are the frames we're going to write
+    uint64_t firstFrame = (uint64_t)firstGroup * frameGroupLength;
+    uint64_t endFrame   = (uint64_t)endGroup   * frameGroupLength;
 
-    // How many diagnostic frames are there?
-    uint32_t diagnosticFrames = config.diagnostic_values.size();
+    // Create the output file, and keep track of our progress as we write it
+    unique_ptr<CFrameWriter> writer(openFrameWriter(target, (endFrame - firstFrame) * config.cells_per_frame, config));
+    writer.reset(new CMonitoredWriter(writer.release(), config.cells_per_frame, &progress));
 
-    // Fetch the name of the file we're going to create
-    const char* filename = config.output_file.c_str();
-   
-    // Open the file we're going to write, and complain if we can't
-    FILE* ofile = fopen(filename, "w");
-    if (ofile == nullptr) throwRuntime("Can't create %s", filename);
+    // Unless the frames are being streamed, checksum each frame group as it's written
+    CChecksumWriter* checksummer = nullptr;
+    if (config.checksums && !CStreamWriter::isStreamTarget(target))
+    {
+        uint64_t groupBytes = (uint64_t)frameGroupLength * config.cells_per_frame;
+        checksummer = new CChecksumWriter(writer.release(), groupBytes, firstGroup);
+        writer.reset(checksummer);
+    }
 
-    // Allocate sufficient RAM to contain an entire raw data frame
-    unique_ptr<uint8_t> framePtr(new uint8_t[config.cells_per_frame]);
+    // If the user asked for a particular placement, tell them what they're actually getting
+    if (cmdLine.numa || placement.hugePages() != HUGE_NONE)
+    {
+        printf("Placement: %s\n", placement.description().c_str());
+    }
 
-    // Get a pointer to the frame data
-    uint8_t* frame  = framePtr.get();
+    // Start the progress reports
+    progress.start(endFrame - firstFrame, config.cells_per_frame, config.progress_interval, cmdLine.statsFile);
 
-    // Loop through each frame group
-    for (int32_t frameGroup = 0; frameGroup < frameGroupCount; ++frameGroup)
+    // If the output file is mapped into memory, frames get built directly into it (and then
+    // checksummed there)
+    if (writer->mappedBase())
     {
+        writeFramesMapped(writer->mappedBase(), firstFrame, endFrame);
+        uint64_t totalBytes = (endFrame - firstFrame) * config.cells_per_frame;
+        if (checksummer) checksummer->checksumMapped(totalBytes, max(1U, cmdLine.threads));
+    }
 
-        // Write the correct number of diagnostic frames to the output file
-        for (i=0; i<diagnosticFrames; ++i)
-        {
-            memset(frame, config.diagnostic_values[i], config.cells_per_frame);
-            fwrite(frame, 1, config.cells_per_frame, ofile);
+    // Otherwise, frames are built either on this thread or on a pool of worker threads
+    else if (cmdLine.threads > 1)
+        writeFramesThreaded(writer.get(), firstFrame, endFrame);
+    else
+        writeFrames(writer.get(), firstGroup, endGroup);
+
+    // We're done with the output file
+    writer->close();
+    progress.stop();
+
+    // Save the checksums alongside it
+    if (checksummer)
+    {
+        writeChecksumFile(target + ".crc", target, checksummer->checksums());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// isUpdatableOutput() - Returns true if the output file is an ordinary file of raw frames, which 
+//                       means that it can later be updated in place with "-update"
+//=================================================================================================
+bool isUpdatableOutput(const config_t& settings)
+{
+    return settings.output_format == "raw"
+       && (settings.output_mode == "stdio" || settings.output_mode == "direct" ||
+           settings.output_mode == "uring" || settings.output_mode == "mmap")
+       && !CStreamWriter::isStreamTarget(settings.output_file);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// saveOutputRecord() - Saves a compiled copy of the distribution alongside the output file, so 
+//                      that "-update" can later work out what has changed
+//
+// Passed: settings = The configuration the output file was created with
+//         builder  = The generator that built the output file
+//=================================================================================================
+void saveOutputRecord(const config_t& settings, const CFrameGenerator& builder)
+{
+    if (!isUpdatableOutput(settings)) return;
+
+    string filename = settings.output_file + ".dist";
+    if (!builder.writeCompiledDistribution(filename, 0, builder.hashLayout()))
+    {
+        printf("Can't write %s, the output file can't be updated with -update\n", filename.c_str());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// sameRecord() - Returns true if two distribution records populate the same cells with the same
+//                sequence of values
+//=================================================================================================
+static bool sameRecord(const distribution_t& a, const distribution_t& b)
+{
+    if (a.first != b.first || a.last != b.last || a.step != b.step || a.length != b.length) return false;
+
+    uint32_t cursorA = 0, cursorB = 0;
+    for (uint32_t i=0; i<a.length; ++i)
+    {
+        if (generator->sequenceValue(a, i, cursorA) != generator->sequenceValue(b, i, cursorB)) return false;
+    }
+
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// alignRecords() - Finds the longest run of records that two lists have in common, in the same
+//                  order, using Myers' difference algorithm.  This takes time proportional to the
+//                  length of the lists multiplied by the number of records that differ
+//
+// Passed:  n, m     = The number of records in the first and in the second list
+//          same     = same(i, j) returns true if record i of the first list and record j of the
+//                     second list are the same record
+//          maxEdits = The most records that can differ before we give up
+//          keptA    = Receives a 1 for each record of the first list that's in the second
+//          keptB    = Receives a 1 for each record of the second list that's in the first
+//
+// Returns: false if more than maxEdits records differ, in which case keptA and keptB are all 0
+//=================================================================================================
+template <class SAME> static bool alignRecords(int64_t n, int64_t m, SAME same, int64_t maxEdits,
+                                               vector<uint8_t>& keptA, vector<uint8_t>& keptB)
+{
+    keptA.assign(n, 0);
+    keptB.assign(m, 0);
+
+    // v[offset+k] is the furthest point reached in the first list along diagonal k.  Before
+    // each step 'd', trace[d] saves diagonals -d-1 through d+1 so that the path can be retraced
+    int64_t maxD   = min(n + m, maxEdits);
+    int64_t offset = maxD + 1;
+    vector<int64_t> v(2 * offset + 1, 0);
+    vector<vector<int64_t>> trace;
+
+    for (int64_t d=0; d<=maxD; ++d)
+    {
+        trace.emplace_back(v.begin() + offset - d - 1, v.begin() + offset + d + 2);
+        for (int64_t k=-d; k<=d; k+=2)
+        {
+            // Step down from diagonal k+1 or across from diagonal k-1, then along any records
+            // that match
+            int64_t x = (k == -d || (k != d && v[offset+k-1] < v[offset+k+1])) ? v[offset+k+1] : v[offset+k-1] + 1;
+            int64_t y = x - k;
+            while (x < n && y < m && same(x, y)) {++x; ++y;}
+            v[offset+k] = x;
+            if (x < n || y < m) continue;
+
+            // We've reached the end of both lists.  Retrace the path, marking the records that
+            // it passes along diagonally
+            for (int64_t e=d; e>=0; --e)
+            {
+                auto& t = trace[e];
+                k = x - y;
+                int64_t prevK = (k == -e || (k != e && t[k-1+e+1] < t[k+1+e+1])) ? k + 1 : k - 1;
+                int64_t prevX = t[prevK+e+1], prevY = prevX - prevK;
+                while (x > prevX && y > prevY)
+                {
+                    --x; --y;
+                    keptA[x] = keptB[y] = 1;
+                }
+                x = prevX;
+                y = prevY;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// updateOutputFile() - Updates an existing output file so that it matches the current distribution
+//
+// The distribution the output file was built from is compared to the current one.  The records
+// they have in common, in the same order, are unchanged, and every other record has been changed,
+// added, or removed.  Only the cells populated by those records can differ, and only in the data
+// frames before the longest of their sequences ends.  Those are the only cells that are
+// recomputed, and only the bytes that differ are written
+//=================================================================================================
+void updateOutputFile(uint32_t frameGroupCount)
+{
+    vector<distribution_t> oldList;
+
+    // Find out how many frames are in the file
+    uint32_t diagnosticFrames = config.diagnostic_values.size();
+    uint32_t frameGroupLength = diagnosticFrames + config.data_frames;
+    uint64_t totalFrames      = (uint64_t)frameGroupCount * frameGroupLength;
+    uint64_t totalBytes       = totalFrames * config.cells_per_frame;
+
+    // Make sure this is an output file that can be updated
+    const char* filename = config.output_file.c_str();
+    if (!isUpdatableOutput(config)) throwRuntime("-update requires a raw output file");
+
+    // Fetch the distribution that the output file was built from.  This only works if the output
+    // file has the same layout that it would have if we built it now
+    string recordName = config.output_file + ".dist";
+    uint64_t layoutHash = generator->hashLayout();
+    auto sameLayout = [&](const cacheHeader_t& header) {return header.layoutHash == layoutHash;};
+    if (!generator->readCompiledDistribution(recordName, sameLayout, oldList))
+    {
+        throwRuntime("%s doesn't match the current configuration, %s must be rebuilt in full", 
+                     recordName.c_str(), filename);
+    }
+
+    // Find the records at the beginning and the end of the list that haven't changed
+    auto& newList = generator->distributionList();
+    size_t prefix = 0, suffix = 0;
+    size_t common = min(oldList.size(), newList.size());
+    while (prefix < common && sameRecord(oldList[prefix], newList[prefix])) ++prefix;
+    while (suffix < common - prefix && sameRecord(oldList[oldList.size()-1-suffix], newList[newList.size()-1-suffix])) ++suffix;
+
+    // Between them, find the records that are in both lists.  Each record gets a fingerprint of
+    // its values, so that most records that differ can be told apart without comparing them in
+    // full.  If too many records have changed, we don't bother, and all of them are recomputed
+    size_t oldCount = oldList.size() - suffix - prefix, newCount = newList.size() - suffix - prefix;
+    auto fingerprint = [&](const distribution_t& dr)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        uint32_t cursor = 0;
+        for (uint32_t i=0; i<dr.length; ++i) hash = (hash ^ generator->sequenceValue(dr, i, cursor)) * 1099511628211ULL;
+        return hash;
+    };
+    vector<uint64_t> oldPrint(oldCount), newPrint(newCount);
+    for (size_t i=0; i<oldCount; ++i) oldPrint[i] = fingerprint(oldList[prefix + i]);
+    for (size_t i=0; i<newCount; ++i) newPrint[i] = fingerprint(newList[prefix + i]);
+    auto same = [&](int64_t i, int64_t j)
+    {
+        return oldPrint[i] == newPrint[j] && sameRecord(oldList[prefix + i], newList[prefix + j]);
+    };
+    vector<uint8_t> kept[2];
+    alignRecords(oldCount, newCount, same, 1000, kept[0], kept[1]);
+
+    // The records that weren't matched up have been changed, added, or removed.  A changed record
+    // is unmatched in both lists, so it's the larger of the two that counts
+    size_t matched = count(kept[1].begin(), kept[1].end(), 1);
+    size_t changedRecords = max(oldCount, newCount) - matched;
+
+    // Mark every cell populated by a record that has changed, and find out how many data frames
+    // those records cover
+    vector<uint8_t> affected(config.cells_per_frame, 0);
+    uint32_t changedFrames = 0;
+    for (int l=0; l<2; ++l)
+    {
+        auto& list = l ? newList : oldList;
+        for (size_t i = prefix; i < list.size() - suffix; ++i)
+        {
+            if (kept[l][i - prefix]) continue;
+            auto& dr = list[i];
+            for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+            {
+                affected[cellNumber] = 1;
+            }
+            changedFrames = max(changedFrames, dr.length);
+        }
+    }
+
+    // For each affected cell, list the current records that populate it, in order
+    vector<uint32_t> cell;
+    vector<int32_t>  cellIndex(config.cells_per_frame, -1);
+    for (uint32_t c=0; c<config.cells_per_frame; ++c) if (affected[c])
+    {
+        cellIndex[c] = cell.size();
+        cell.push_back(c);
+    }
+    vector<vector<uint32_t>> cover(cell.size());
+    for (uint32_t i=0; i<newList.size(); ++i)
+    {
+        auto& dr = newList[i];
+        for (uint32_t cellNumber = dr.first-1; cellNumber < (uint32_t)dr.last; cellNumber += dr.step)
+        {
+            if (cellIndex[cellNumber] >= 0) cover[cellIndex[cellNumber]].push_back(i);
+        }
+    }
+
+    // Open the output file and make sure it's the size we expect
+    int fd = ::open(filename, O_RDWR);
+    if (fd < 0) throwRuntime("Can't open %s", filename);
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || (uint64_t)sb.st_size != totalBytes)
+    {
+        ::close(fd);
+        throwRuntime("%s isn't the expected size, it must be rebuilt in full", filename);
+    }
+
+    // Map it into memory.   The cells we touch are scattered throughout the file
+    uint8_t* base = nullptr;
+    if (totalBytes && !cell.empty())
+    {
+        void* p = mmap(nullptr, totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            throwRuntime("Can't map %s into memory", filename);
+        }
+        madvise(p, totalBytes, MADV_RANDOM);
+        base = (uint8_t*)p;
+    }
+    ::close(fd);
+
+    // The position of each affected cell within a frame
+    vector<uint32_t> position(cell.size());
+    for (size_t i=0; i<cell.size(); ++i)
+    {
+        position[i] = cmdLine.nolvds ? cell[i] : cellPosition<true>(cell[i]);
+    }
+
+    // Recompute the affected cells in every data frame that a changed record covers
+    uint64_t bytesChanged = 0;
+    uint32_t dataFrames   = min<uint64_t>(changedFrames, (uint64_t)frameGroupCount * config.data_frames);
+    vector<uint32_t> cursor(newList.size(), 0);
+    for (uint32_t frameNumber = 0; base && frameNumber < dataFrames; ++frameNumber)
+    {
+        // Find where this data frame is in the file
+        uint64_t frameIndex = (uint64_t)(frameNumber / config.data_frames) * frameGroupLength 
+                            + diagnosticFrames + frameNumber % config.data_frames;
+        uint8_t* frame = base + frameIndex * config.cells_per_frame;
+
+        for (size_t i=0; i<cell.size(); ++i)
+        {
+            // The last record that has data for this frame determines the cell's value
+            uint8_t value = config.quiescent;
+            for (auto it = cover[i].rbegin(); it != cover[i].rend(); ++it)
+            {
+                auto& dr = newList[*it];
+                if (frameNumber < dr.length)
+                {
+                    value = generator->sequenceValue(dr, frameNumber, cursor[*it]);
+                    break;
+                }
+            }
+
+            // Only write the bytes that differ
+            if (frame[position[i]] != value)
+            {
+                frame[position[i]] = value;
+                ++bytesChanged;
+            }
+        }
+    }
+
+    // Bring the checksums up to date.  Only the frame groups that hold the affected data frames
+    // can have changed
+    vector<groupChecksum_t> checksum;
+    string checksumName = config.output_file + ".crc";
+    try
+    {
+        if (base && readChecksumFile(checksumName, checksum))
+        {
+            uint32_t changedGroups = (dataFrames + config.data_frames - 1) / config.data_frames;
+            if (checksum.size() == frameGroupCount)
+            {
+                for (uint32_t g=0; g<changedGroups; ++g)
+                {
+                    checksum[g].crc = crc32c(0, base + checksum[g].offset, checksum[g].length);
+                }
+                writeChecksumFile(checksumName, config.output_file, checksum);
+            }
+            else
+            {
+                printf("%s doesn't match %s and has been removed\n", checksumName.c_str(), filename);
+                remove(checksumName.c_str());
+            }
+        }
+    }
+    catch (...)
+    {
+        munmap(base, totalBytes);
+        throw;
+    }
+
+    // Make sure the changes make it to disk, then we're done with the file
+    if (base)
+    {
+        int status = msync(base, totalBytes, MS_SYNC);
+        munmap(base, totalBytes);
+        if (status < 0) throwRuntime("Can't write %s: %s", filename, strerror(errno));
+    }
+
+    // The output file now matches the current distribution
+    if (!generator->writeCompiledDistribution(recordName, 0, layoutHash))
+    {
+        throwRuntime("Can't write %s", recordName.c_str());
+    }
+
+    // Tell the user what we did
+    printf("%'16lu Distribution records changed\n", changedRecords);
+    printf("%'16lu Cells affected\n", cell.size());
+    printf("%'16u Data frames affected\n", dataFrames);
+    printf("%'16lu Bytes rewritten\n", bytesChanged);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// verifyOutputFile() - Rebuilds every frame and checks that the output file matches
+//
+// Threads claim frame groups one at a time, rebuild each one in memory, and compare it to the
+// output file.  If the output file can't be read back as raw frames, each rebuilt frame group is
+// compared to its checksum in <output_file>.crc instead
+//
+// Passed: frameGroupCount = The number of frame groups in the output file
+//=================================================================================================
+void verifyOutputFile(uint32_t frameGroupCount)
+{
+    uint32_t frameGroupLength = generator->frameGroupLength();
+    uint64_t groupBytes       = (uint64_t)frameGroupLength * config.cells_per_frame;
+    uint64_t totalBytes       = groupBytes * frameGroupCount;
+    const char* filename      = config.output_file.c_str();
+    string   checksumName     = config.output_file + ".crc";
+
+    // If the output file is an ordinary file of raw frames, map it into memory
+    const uint8_t* base = nullptr;
+    int fd = -1;
+    if (config.output_format == "raw" && config.output_mode != "contig" 
+    &&  !CStreamWriter::isStreamTarget(config.output_file))
+    {
+        fd = ::open(filename, O_RDONLY);
+    }
+    bool haveFile = (fd >= 0);
+    if (haveFile)
+    {
+        struct stat sb;
+        if (fstat(fd, &sb) < 0)
+        {
+            ::close(fd);
+            throwRuntime("Can't stat %s", filename);
+        }
+        if ((uint64_t)sb.st_size != totalBytes)
+        {
+            ::close(fd);
+            printf("%s is %'lu bytes, but should be %'lu bytes\n", filename, sb.st_size, totalBytes);
+            exit(1);
+        }
+        void* p = totalBytes ? mmap(nullptr, totalBytes, PROT_READ, MAP_SHARED, fd, 0) : nullptr;
+        ::close(fd);
+        if (p == MAP_FAILED) throwRuntime("Can't map %s into memory", filename);
+        if (p) madvise(p, totalBytes, MADV_SEQUENTIAL);
+        base = (const uint8_t*)p;
+    }
+
+    // Otherwise, we'll compare the frames to their checksums
+    vector<groupChecksum_t> checksum;
+    if (!haveFile)
+    {
+        if (!readChecksumFile(checksumName, checksum))
+        {
+            throwRuntime("Can't verify: neither %s nor %s can be read", filename, checksumName.c_str());
+        }
+        if (checksum.size() != frameGroupCount)
+        {
+            printf("%s has %lu frame groups, but there should be %u\n", checksumName.c_str(), checksum.size(),
+                   frameGroupCount);
+            exit(1);
+        }
+    }
+
+    printf("Verifying %'u frame groups against %s\n", frameGroupCount, haveFile ? filename : checksumName.c_str());
+    fflush(stdout);
+
+    // For each frame group, the index of the first frame that doesn't match (or -1 if they all do).
+    // When checking against checksums, a frame group that doesn't match is blamed on its first frame
+    vector<int64_t> badFrame(frameGroupCount, -1);
+    atomic<uint32_t> nextGroup(0);
+
+    auto worker = [&]()
+    {
+        vector<uint8_t> rebuilt(groupBytes);
+        for (uint32_t g = nextGroup++; g < frameGroupCount; g = nextGroup++)
+        {
+            uint64_t firstFrame = (uint64_t)g * frameGroupLength;
+            generator->fill(firstFrame, frameGroupLength, rebuilt.data());
+
+            if (base)
+            {
+                const uint8_t* stored = base + g * groupBytes;
+                if (memcmp(stored, rebuilt.data(), groupBytes) == 0) continue;
+                for (uint32_t f=0; f<frameGroupLength; ++f)
+                {
+                    uint64_t offset = (uint64_t)f * config.cells_per_frame;
+                    if (memcmp(stored + offset, rebuilt.data() + offset, config.cells_per_frame) != 0)
+                    {
+                        badFrame[g] = firstFrame + f;
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                const groupChecksum_t& gc = checksum[g];
+                bool match = gc.group == g && gc.length == groupBytes
+                          && gc.crc == crc32c(0, rebuilt.data(), groupBytes);
+                if (!match) badFrame[g] = firstFrame;
+            }
+        }
+    };
+
+    // Check the frame groups on a pool of worker threads
+    vector<thread> pool;
+    uint32_t workerCount = max(1U, cmdLine.threads);
+    for (uint32_t i=1; i<workerCount; ++i) pool.push_back(thread(worker));
+    worker();
+    for (auto& t : pool) t.join();
+    if (base) munmap((void*)base, totalBytes);
+
+    // Report the frame groups that don't match (up to a point)
+    uint32_t mismatches = 0;
+    for (uint32_t g=0; g<frameGroupCount; ++g) if (badFrame[g] >= 0)
+    {
+        if (++mismatches <= 20) printf("Frame group %u doesn't match, starting at frame %'ld\n", g, badFrame[g]);
+    }
+
+    if (mismatches)
+    {
+        printf("%'u of %'u frame groups don't match\n", mismatches, frameGroupCount);
+        exit(1);
+    }
+    printf("All %'u frame groups match\n", frameGroupCount);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// shardFileName() - Returns the name of the file that holds the specified shard
+//=================================================================================================
+string shardFileName(uint32_t index)
+{
+    return config.output_file + ".shard" + to_string(index) + "of" + to_string(cmdLine.shardCount);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeShardManifest() - Writes the manifest that describes how the output file is divided into
+//                        shards.  Every shard writes the same manifest, so it doesn't matter which
+//                        of them runs first or where
+//
+// Each line that isn't a comment describes one shard, in order:
+//    <filename> <byte offset> <byte count> <first frame> <frame count>
+//
+// Concatenating the shard files in that order reproduces the output file exactly
+//=================================================================================================
+void writeShardManifest(uint32_t frameGroupCount)
+{
+    uint32_t frameGroupLength = config.diagnostic_values.size() + config.data_frames;
+
+    // Build the text of the manifest
+    string text = "# Concatenate these files, in this order, to form " + config.output_file + "\n"
+                  "# <filename> <byte offset> <byte count> <first frame> <frame count>\n";
+    for (uint32_t i=0; i<cmdLine.shardCount; ++i)
+    {
+        uint64_t firstFrame = (uint64_t)frameGroupCount *  i      / cmdLine.shardCount * frameGroupLength;
+        uint64_t endFrame   = (uint64_t)frameGroupCount * (i + 1) / cmdLine.shardCount * frameGroupLength;
+        text += shardFileName(i) + " " 
+              + to_string(firstFrame * config.cells_per_frame) + " "
+              + to_string((endFrame - firstFrame) * config.cells_per_frame) + " "
+              + to_string(firstFrame) + " " + to_string(endFrame - firstFrame) + "\n";
+    }
+
+    // Write it to a temporary file, then put it in place
+    string filename = config.output_file + ".manifest";
+    string tempName = filename + ".tmp" + to_string(cmdLine.shardIndex);
+    FILE* ofile = fopen(tempName.c_str(), "w");
+    if (ofile == nullptr) throwRuntime("Can't create %s", tempName.c_str());
+    bool ok = fwrite(text.data(), 1, text.size(), ofile) == text.size();
+    ok = (fclose(ofile) == 0) && ok;
+    if (!ok || rename(tempName.c_str(), filename.c_str()) != 0)
+    {
+        remove(tempName.c_str());
+        throwRuntime("Can't write %s", filename.c_str());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFrames() - Builds the frames of the output file one at a time and writes them
+//=================================================================================================
+void writeFrames(CFrameWriter* writer, uint32_t firstGroup, uint32_t endGroup)
+{
+    uint32_t i, frameNumber = firstGroup * config.data_frames;
+
+    // How many diagnostic frames are there?
+    uint32_t diagnosticFrames = config.diagnostic_values.size();
+
+    // Allocate sufficient RAM to contain an entire data frame
+    CFrameBuffer frameBuffer;
+    frameBuffer.allocate(config.cells_per_frame, placement.hugePages());
+
+    // Get a pointer to the frame data
+    uint8_t* frame  = frameBuffer.data();
+
+    // This keeps track of which distribution records are live
+    frameBuilder_t fb;
+
+    // This becomes true once 'frame' holds the most recently written data frame
+    bool haveFrame = false;
+
+    // Loop through each frame group
+    for (uint32_t frameGroup = firstGroup; frameGroup < endGroup; ++frameGroup)
+    {
+
+        // Write the correct number of diagnostic frames to the output file
+        for (i=0; i<diagnosticFrames; ++i)
+        {
+            writer->write(generator->uniformFrame(config.diagnostic_values[i]).data(), config.cells_per_frame);
+        }
+
+        // For each data frame in this frame group...
+        for (i=0; i<config.data_frames; ++i, ++frameNumber)
+        {
+            // Once every fragment sequence has ended, data frames are entirely quiescent
+            if (generator->isQuiescentFrame(frameNumber))
+            {
+                writer->write(generator->uniformFrame(config.quiescent).data(), config.cells_per_frame);
+                continue;
+            }
+
+            // Build the data frame for this frame number
+            const uint8_t* built = generator->buildDataFrame(fb, frame, frameNumber);
+
+            // If the frame was built in raw order, translate it into LVDS order.  In "-delta" 
+            // mode, if this frame is identical to the previous one, the frame we translated
+            // last time can simply be written again
+            if (generator->lvdsReorderPass())
+            {
+                if (!cmdLine.delta)
+                    generator->reorderForLvds(frame);
+                else if (!haveFrame || fb.deltaChanged)
+                    generator->reorderForLvds(built, frame);
+                built = frame;
+            }
+
+            // And write the resulting frame to the output file
+            writer->write(built, config.cells_per_frame);
+            haveFrame = true;
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFramesThreaded() - Builds the frames of the output file on a pool of worker threads
+//
+// The output file is divided into batches of consecutive frames.  Worker threads claim batches
+// in ascending order and build them into a ring of batch buffers, while this thread writes the
+// completed batches to the output file strictly in order.  The resulting file is byte-for-byte
+// identical to the one created by writeFrames()
+//
+// With "-numa", each worker builds every workerCount'th batch instead of claiming them, so that
+// the two slots it builds into always belong to it and can live in its own node's memory
+//=================================================================================================
+void writeFramesThreaded(CFrameWriter* writer, uint64_t firstFrame, uint64_t endFrame)
+{
+    // How many frames are we writing?
+    uint64_t totalFrames = endFrame - firstFrame;
+
+    // This describes a single buffer in the ring of batch buffers
+    struct batchSlot_t
+    {
+        CFrameBuffer    data;
+        uint64_t        batch;
+        bool            ready;
+    };
+
+    // How many worker threads are we going to run?
+    uint32_t workerCount = cmdLine.threads;
+
+    // Each batch is roughly 4 MB worth of frames
+    uint32_t batchFrames = (4 * 1024 * 1024) / config.cells_per_frame;
+    if (batchFrames == 0) batchFrames = 1;
+
+    // How many batches are there in the entire output file?
+    uint64_t batchCount = (totalFrames + batchFrames - 1) / batchFrames;
+
+    // Give every worker two batch buffers so it never has to wait for the writer very long
+    uint32_t slotCount = 2 * workerCount;
+
+    // Allocate the ring of batch buffers.  Batch 'b' is built in slot b % slotCount, so (when
+    // workers are pinned) slot 's' is only ever used by worker s % workerCount
+    vector<batchSlot_t> slot(slotCount);
+    for (uint32_t i=0; i<slotCount; ++i)
+    {
+        int node = placement.workerNode(i % workerCount);
+        slot[i].data.allocate((size_t)batchFrames * config.cells_per_frame, placement.hugePages(), node);
+        slot[i].ready = false;
+    }
+
+    // These coordinate the worker threads with the writer
+    mutex              mtx;
+    condition_variable cvReady, cvFree;
+    atomic<uint64_t>   nextBatch(0);
+    uint64_t           writtenBatches = 0;
+
+    // This is set if the writer fails, so that the workers stop instead of waiting for it forever
+    bool               aborted = false;
+
+    // This is the code that each worker thread runs
+    auto worker = [&](uint32_t index)
+    {
+        frameBuilder_t fb;
+
+        placement.pinWorker(index);
+
+        for (uint64_t batch = index; true; batch += workerCount)
+        {
+            // Claim the next batch that nobody has built yet (or, with pinned workers, our next one)
+            if (!placement.pinning()) batch = nextBatch++;
+            if (batch >= batchCount) break;
+
+            // This is the slot in the ring that this batch will be built in
+            batchSlot_t& s = slot[batch % slotCount];
+
+            // Wait for the writer to finish with the batch that previously occupied this slot
+            {
+                unique_lock<mutex> lock(mtx);
+                cvFree.wait(lock, [&]{return aborted || writtenBatches + slotCount > batch;});
+                if (aborted) break;
+            }
+
+            // Build every frame of this batch into the slot
+            uint64_t batchFirst = firstFrame + batch * batchFrames;
+            uint64_t batchEnd   = min(batchFirst + batchFrames, endFrame);
+            uint8_t* frame      = s.data.data();
+            for (uint64_t frameIndex = batchFirst; frameIndex < batchEnd; ++frameIndex)
+            {
+                generator->buildFrame(fb, frame, frameIndex);
+                frame += config.cells_per_frame;
+            }
+
+            // Tell the writer that this batch is ready to be written
+            {
+                lock_guard<mutex> lock(mtx);
+                s.batch = batch;
+                s.ready = true;
+            }
+            cvReady.notify_all();
+        }
+    };
+
+    // Start the worker threads
+    vector<thread> pool;
+    for (uint32_t i=0; i<workerCount; ++i) pool.push_back(thread(worker, i));
+
+    // Write each batch to the output file in order
+    try
+    {
+        for (uint64_t batch = 0; batch < batchCount; ++batch)
+        {
+            batchSlot_t& s = slot[batch % slotCount];
+
+            // Wait for this batch to be built
+            {
+                unique_lock<mutex> lock(mtx);
+                cvReady.wait(lock, [&]{return s.ready && s.batch == batch;});
+            }
+
+            // How many frames are in this batch?  (The final batch may be short)
+            uint64_t frames = min((uint64_t)batchFrames, totalFrames - batch * batchFrames);
+
+            // Write this batch to the output file
+            writer->write(s.data.data(), frames * config.cells_per_frame);
+
+            // Hand the slot back to the worker threads
+            {
+                lock_guard<mutex> lock(mtx);
+                s.ready = false;
+                writtenBatches = batch + 1;
+            }
+            cvFree.notify_all();
+        }
+    }
+
+    // If the write failed, stop the workers and wait for them before passing the error on
+    catch (...)
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            aborted = true;
+        }
+        cvFree.notify_all();
+        cvReady.notify_all();
+        for (auto& t : pool) t.join();
+        throw;
+    }
+
+    // Wait for all of the worker threads to finish
+    for (auto& t : pool) t.join();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFramesMapped() - Builds the frames of the output file directly into the memory that the
+//                       output file is mapped to
+//
+// Passed: base        = The address of the first byte of the mapped output file
+//         totalFrames = The number of frames in the output file
+//
+// Each thread fills its own range of consecutive frames, so no writer thread is involved
+//=================================================================================================
+void writeFramesMapped(uint8_t* base, uint64_t firstFrame, uint64_t endFrame)
+{
+    // How many frames are we writing?
+    uint64_t totalFrames = endFrame - firstFrame;
+
+    // How many threads are going to build frames?
+    uint32_t workerCount = cmdLine.threads ? cmdLine.threads : 1;
+
+    // This builds the frames in the range [rangeFirst, rangeEnd).  The first frame we're
+    // writing goes at the start of the mapping
+    auto worker = [&](uint32_t index, uint64_t rangeFirst, uint64_t rangeEnd)
+    {
+        frameBuilder_t fb;
+        uint64_t built = 0;
+
+        // With "-numa", the pages of our range get faulted in on our own node
+        placement.pinWorker(index);
+
+        for (uint64_t frameIndex = rangeFirst; frameIndex < rangeEnd; ++frameIndex)
+        {
+            generator->buildFrame(fb, base + (frameIndex - firstFrame) * config.cells_per_frame, frameIndex);
+
+            // Report our progress now and then, rather than after every frame
+            if (++built == 1024)
+            {
+                progress.addFrames(built);
+                built = 0;
+            }
+        }
+        progress.addFrames(built);
+    };
+
+    // If there's only one thread, we'll build every frame right here
+    if (workerCount == 1)
+    {
+        worker(0, firstFrame, endFrame);
+        return;
+    }
+
+    // Give each worker thread a contiguous range of frames to build
+    vector<thread> pool;
+    for (uint32_t i=0; i<workerCount; ++i)
+    {
+        uint64_t rangeFirst = firstFrame + totalFrames *  i      / workerCount;
+        uint64_t rangeEnd   = firstFrame + totalFrames * (i + 1) / workerCount;
+        pool.push_back(thread(worker, i, rangeFirst, rangeEnd));
+    }
+
+    // Wait for all of the worker threads to finish
+    for (auto& t : pool) t.join();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// openFrameWriter() - Creates the output file using the back-end selected by the "output_mode"
+//                     configuration setting
+//
+// Passed:  totalBytes = The number of bytes that will be written to the output file
+//          settings   = The configuration that selects the back-end
+//
+// Returns: A back-end that the caller owns and is responsible for deleting
+//=================================================================================================
+CFrameWriter* openFrameWriter(string target, uint64_t totalBytes, const config_t& settings)
+{
+    CFrameWriter* writer;
+
+    // Create the back-end that the configuration file asks for.  Streams (stdout and TCP) have
+    // a back-end of their own
+    if (CStreamWriter::isStreamTarget(target))
+    {
+        if (settings.output_mode == "mmap" || settings.output_mode == "contig")
+        {
+            throwRuntime("output_mode '%s' can't be used with output_file '%s'", 
+                         settings.output_mode.c_str(), target.c_str());
+        }
+        writer = new CStreamWriter(settings.write_buffer_size);
+    }
+    else if (settings.output_mode == "stdio")
+        writer = new CStdioWriter;
+    else if (settings.output_mode == "direct")
+        writer = new CDirectWriter(settings.write_buffer_size);
+    else if (settings.output_mode == "uring")
+        writer = new CUringWriter(settings.write_buffer_size, settings.uring_queue_depth);
+    else if (settings.output_mode == "mmap")
+        writer = new CMappedWriter;
+    else if (settings.output_mode == "contig")
+    {
+        // When we're filling the contiguous buffer directly, the target is the device
+        writer = new CContigWriter(settings.contig_offset);
+        target = settings.contig_device;
+        printf("Writing frames into %s at offset 0x%lx\n", target.c_str(), settings.contig_offset);
+    }
+    else
+        throwRuntime("Invalid output_mode '%s'", settings.output_mode.c_str());
+
+    // If the output should be run-length encoded or compressed, the back-end we just created
+    // writes the encoded data.   That only works for back-ends that write data sequentially
+    if (settings.output_format == "rle" || settings.output_format == "chunked")
+    {
+        if (settings.output_mode == "mmap" || settings.output_mode == "contig")
+        {
+            delete writer;
+            throwRuntime("output_format '%s' can't be used with output_mode '%s'", 
+                         settings.output_format.c_str(), settings.output_mode.c_str());
+        }
+        if (settings.output_format == "rle")
+            writer = new CRleWriter(writer, settings.cells_per_frame);
+        else
+        {
+            // Each frame group is compressed on its own, on a pool of threads
+            uint32_t chunkFrames = settings.diagnostic_values.size() + settings.data_frames;
+            writer = new CChunkedWriter(writer, settings.cells_per_frame, chunkFrames, max(1U, cmdLine.threads),
+                                        settings.compression_level);
+        }
+    }
+    else if (settings.output_format != "raw")
+    {
+        delete writer;
+        throwRuntime("Invalid output_format '%s'", settings.output_format.c_str());
+    }
+
+    // Create the output file.  If that fails, don't leak the back-end
+    try
+    {
+        writer->open(target, totalBytes);
+    }
+    catch (...)
+    {
+        delete writer;
+        throw;
+    }
+
+    // Hand the caller the open back-end
+    return writer;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// expandRleFile() - Expands the run-length encoded output file into an ordinary output file
+//
+// Passed: filename = The name of the ordinary output file to create
+//=================================================================================================
+void expandRleFile(string filename)
+{
+    char     magic[sizeof CRleWriter::MAGIC];
+    uint32_t frameSize, runCount;
+    uint64_t totalFrames, framesWritten = 0;
+
+    // Fetch the name of the run-length encoded file
+    const char* rleFilename = config.output_file.c_str();
+
+    // Open the run-length encoded file and complain if we can't
+    FILE* ifile = fopen(rleFilename, "r");
+    if (ifile == nullptr) throwRuntime("Can't open %s", rleFilename);
+
+    // Read the file header and make sure this really is a run-length encoded file
+    if (fread(magic,        1, sizeof magic,       ifile) != sizeof magic
+    ||  fread(&frameSize,   1, sizeof frameSize,   ifile) != sizeof frameSize
+    ||  fread(&totalFrames, 1, sizeof totalFrames, ifile) != sizeof totalFrames
+    ||  memcmp(magic, CRleWriter::MAGIC, sizeof magic) != 0 || frameSize == 0)
+    {
+        fclose(ifile);
+        throwRuntime("%s is not a run-length encoded file", rleFilename);
+    }
+
+    // Create the expanded file
+    FILE* ofile = fopen(filename.c_str(), "w");
+    if (ofile == nullptr)
+    {
+        fclose(ifile);
+        throwRuntime("Can't create %s", filename.c_str());
+    }
+
+    // Allocate sufficient RAM to contain an entire frame
+    vector<uint8_t> frame(frameSize);
+
+    // Read each run, and write its frame however many times it is repeated
+    try
+    {
+        while (fread(&runCount, 1, sizeof runCount, ifile) == sizeof runCount)
+        {
+            if (fread(frame.data(), 1, frameSize, ifile) != frameSize)
+            {
+                throwRuntime("%s is truncated", rleFilename);
+            }
+            for (uint32_t i=0; i<runCount; ++i)
+            {
+                if (fwrite(frame.data(), 1, frameSize, ofile) != frameSize)
+                {
+                    throwRuntime("Can't write %s: %s", filename.c_str(), strerror(errno));
+                }
+            }
+            framesWritten += runCount;
+        }
+    }
+    catch (...)
+    {
+        fclose(ifile);
+        fclose(ofile);
+        throw;
+    }
+
+    // We're done with both files.  Closing the expanded file flushes whatever stdio is still
+    // buffering, so that can fail too
+    fclose(ifile);
+    if (fclose(ofile) != 0) throwRuntime("Can't write %s: %s", filename.c_str(), strerror(errno));
+
+    // Make sure we found every frame the header says there should be
+    if (framesWritten != totalFrames)
+    {
+        throwRuntime("%s contains %lu frames, expected %lu", rleFilename, framesWritten, totalFrames);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parseCellList() - Parses a comma-separated list of cell numbers and ranges (such as "1,5,10-20")
+//                   into a list of cell numbers
+//
+// If the text is "@<filename>", the list is read from that file, and may span any number of lines
+//=================================================================================================
+vector<uint32_t> parseCellList(string text)
+{
+    vector<uint32_t> result;
+    char token[1000];
+    string line;
+
+    // If the list is in a file, fetch the whole thing as one line of text
+    if (!text.empty() && text[0] == '@')
+    {
+        ifstream file(text.substr(1));
+        if (!file.is_open()) throwRuntime("Can't open %s", text.c_str() + 1);
+        text.clear();
+        while (getline(file, line)) text += line + ",";
+        for (char& c : text) if (c == 10 || c == 13) c = ',';
+    }
+
+    const char* p = text.c_str();
+
+    // Loop through each comma-separated token in the list
+    while (getNextCommaSeparatedToken(p, token))
+    {
+        // Ignore empty tokens
+        if (token[0] == 0) continue;
+
+        // A token is either a single cell number, or a range of them
+        char* dash = strchr(token, '-');
+        unsigned long first = strtoul(token, nullptr, 10);
+        unsigned long last  = dash ? strtoul(dash + 1, nullptr, 10) : first;
+
+        // Complain about ranges that run backwards, and about cells that don't exist (before a
+        // huge range gets expanded)
+        if (last < first) throwRuntime("Invalid cell range '%s' on -trace", token);
+        if (last >= config.cells_per_frame)
+        {
+            throwRuntime("Cell %lu is out of range (a frame has %u cells)", last, config.cells_per_frame);
         }
 
-        // For each data frame in this frame group...
-        for (i=0; i<config.data_frames; ++i)
+        // And add every cell in the range to the list
+        for (uint32_t cellNumber = first; cellNumber <= last; ++cellNumber)
         {
-            // Build the raw data frame for this frame number
-            buildDataFrame(frame, frameNumber++);
-            
-            // If the user said "-nolvds", the LVDS frame is the same as the raw frame
-            if (!cmdLine.nolvds) reorderForLvds(frame);
+            result.push_back(cellNumber);
+        }
+    }
 
-            // And write the resulting frame to the output file
-            fwrite(frame, 1, config.cells_per_frame, ofile);
+    // Complain if there are no cells at all
+    if (result.empty()) throwRuntime("No cells specified on -trace");
+
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// traceOffsets() - Returns the offset within a frame of the output file of each cell in a list
+//=================================================================================================
+vector<uint32_t> traceOffsets(const vector<uint32_t>& cellList)
+{
+    vector<uint32_t> offset;
+
+    for (uint32_t cellNumber : cellList)
+    {
+        // Complain about cells that don't exist
+        if (cellNumber >= config.cells_per_frame)
+        {
+            throwRuntime("Cell %u is out of range (a frame has %u cells)", cellNumber, config.cells_per_frame);
         }
+
+        // Unless the user said "-nolvds" on the command line, we need to translate the 
+        // cell number to account for LVDS re-ordering
+        offset.push_back(cmdLine.nolvds ? cellNumber : cellPosition<true>(cellNumber));
     }
 
-    // We're done with the output file
-    fclose(ofile);
+    return offset;
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// findLvdsCellOffset() - For a given cell offset within a row, determine the offset of that 
-//                        cell in a row that has been re-ordered to accomodate LVDS
+// traceFrameCount() - Returns the number of complete frames in the output file, however it's
+//                     stored
 //=================================================================================================
-int findLvdsCellOffset(int rawCellOffset)
+static uint64_t traceFrameCount(const char* filename)
 {
-    for (int i=0; i<ROW_SIZE; ++i)
+    if (CChunkedReader::isChunkedFile(filename))
     {
-        if (lvdsTranslationTable[i] == rawCellOffset) return i;
+        CChunkedReader reader;
+        reader.open(filename);
+        return reader.frameCount();
     }
 
-    // If we can't find that cell offset in our translation table, that's a bug!
-    throwRuntime("BUG: findLvdsCellOffset with invalid cell offset %i", rawCellOffset);
+    if (CRleReader::isRleFile(filename))
+    {
+        CRleReader reader;
+        reader.open(filename);
+        return reader.frameCount();
+    }
 
-    // This is just here to keep to keep the compiler happy
-    return 0;
+    struct stat sb;
+    if (stat(filename, &sb) < 0) throwRuntime("Can't open %s", filename);
+    return sb.st_size / config.cells_per_frame;
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// trace() - Displays the value of a single cell for every frame in the output file
+// readFrameBlocks() - Reads every frame of the output file from front to back, a block of frames
+//                     at a time, and hands each block to 'visit'
+//
+// Passed: filename = The name of the output file
+//         visit    = Called with the number of frames in the block, and the frames themselves
+//
+// A raw file is mapped into memory and each block is part of the mapping, so only the pages that
+// hold the bytes the caller looks at are read.  A chunked file is expanded a chunk per thread on
+// -threads threads, and a run-length encoded file is expanded one run after another
 //=================================================================================================
-void trace(uint32_t cellNumber)
+static void readFrameBlocks(const char* filename, const function<void(uint32_t, const uint8_t*)>& visit)
 {
-    bool first = true;
+    uint32_t frameSize = config.cells_per_frame;
+
+    // The file has to be made of frames the size that we expect
+    auto checkFrameSize = [&](uint32_t fileFrameSize)
+    {
+        if (fileFrameSize != frameSize)
+        {
+            throwRuntime("%s has %u-byte frames, but cells_per_frame is %u", filename, fileFrameSize, frameSize);
+        }
+    };
 
-    // Unless the user said "-nolvds" on the command line, we need to translate the 
-    // cell number to account for LVDS re-ordering
-    if (!cmdLine.nolvds)
+    // A chunked file is expanded -threads chunks at a time.  Every chunk but the last one is full,
+    // so the frames of each block are contiguous
+    if (CChunkedReader::isChunkedFile(filename))
     {
-        // Which row number is this cell in?
-        int row = cellNumber / ROW_SIZE;
-        
-        // What's the cell offset within the row?
-        int rawCellOffset = cellNumber % ROW_SIZE;
+        CChunkedReader reader;
+        reader.open(filename);
+        checkFrameSize(reader.frameSize());
+
+        uint32_t threads    = max(1U, cmdLine.threads);
+        size_t   chunkBytes = (size_t)reader.chunkFrames() * frameSize;
+        vector<uint8_t> block(threads * chunkBytes);
+        for (uint64_t firstChunk = 0; firstChunk < reader.chunkCount(); firstChunk += threads)
+        {
+            uint32_t chunks = min<uint64_t>(threads, reader.chunkCount() - firstChunk);
+            vector<string> failure(chunks);
+            auto expand = [&](uint32_t i)
+            {
+                try
+                {
+                    reader.readChunk(firstChunk + i, block.data() + i * chunkBytes);
+                }
+                catch (const exception& e)
+                {
+                    failure[i] = e.what();
+                }
+            };
+
+            vector<thread> pool;
+            for (uint32_t i=1; i<chunks; ++i) pool.push_back(thread(expand, i));
+            expand(0);
+            for (auto& t : pool) t.join();
+            for (auto& f : failure) if (!f.empty()) throwRuntime("%s", f.c_str());
+
+            visit((chunks - 1) * reader.chunkFrames() + reader.framesInChunk(firstChunk + chunks - 1), block.data());
+        }
+        return;
+    }
 
-        // Determine the offset of that cell in a row that has been LVDS re-ordered
-        int lvdsCellOffset = findLvdsCellOffset(rawCellOffset);
+    // A run-length encoded file is expanded about 32 MB of frames at a time
+    uint32_t blockFrames = max(1U, (32U << 20) / frameSize);
+    if (CRleReader::isRleFile(filename))
+    {
+        CRleReader reader;
+        reader.open(filename);
+        checkFrameSize(reader.frameSize());
 
-        // And compute the cellNumber of our cell in a frame that has been LVDS re-ordered
-        cellNumber = row * ROW_SIZE + lvdsCellOffset;
+        vector<uint8_t> block((size_t)blockFrames * frameSize);
+        for (uint64_t frameIndex = 0; frameIndex < reader.frameCount(); frameIndex += blockFrames)
+        {
+            uint32_t frames = min<uint64_t>(blockFrames, reader.frameCount() - frameIndex);
+            reader.read(frames, block.data());
+            visit(frames, block.data());
+        }
+        return;
     }
 
-    // Fetch the name of the file we're going to open
-    const char* filename = config.output_file.c_str();
+    // Anything else is raw frames.  Open the file, and complain if we can't
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) throwRuntime("Can't open %s", filename);
 
-    // Open the file we're going to read, and complain if we can't
-    FILE* ifile = fopen(filename, "r");
-    if (ifile == nullptr) throwRuntime("Can't create %s", filename);
+    // Find out how many complete frames are in the file
+    struct stat sb;
+    if (fstat(fd, &sb) < 0)
+    {
+        ::close(fd);
+        throwRuntime("Can't stat %s", filename);
+    }
+    uint64_t frameCount = sb.st_size / frameSize;
 
-    // Allocate sufficient RAM to contain an entire data frame
-    unique_ptr<uint8_t> framePtr(new uint8_t[config.cells_per_frame]);
+    // Map the file into memory.  The file is read front to back, and when frames are only a page
+    // or two long nearly every page is touched, so the kernel should read ahead.  Only when frames
+    // span many pages are the pages we touch scattered sparsely enough that read-ahead is wasted
+    const uint8_t* base = nullptr;
+    if (frameCount)
+    {
+        void* p = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            ::close(fd);
+            throwRuntime("Can't map %s into memory", filename);
+        }
+        bool sparse = (long)frameSize > 4 * sysconf(_SC_PAGESIZE);
+        madvise(p, sb.st_size, sparse ? MADV_RANDOM : MADV_SEQUENTIAL);
+        base = (const uint8_t*)p;
+    }
 
-    // Get a pointer to the frame data
-    uint8_t* frame = framePtr.get();
+    // The mapping keeps the file available, so we're done with the descriptor
+    ::close(fd);
 
-    // Loop through each frame of the file...
-    while (fread(frame, 1, config.cells_per_frame, ifile) == config.cells_per_frame)
+    // Hand the frames over straight from the mapping
+    try
+    {
+        for (uint64_t frameIndex = 0; frameIndex < frameCount; frameIndex += blockFrames)
+        {
+            visit(min<uint64_t>(blockFrames, frameCount - frameIndex), base + frameIndex * frameSize);
+        }
+    }
+    catch (...)
     {
-        // If this isn't the first value we've output, print a comma separator
-        if (!first) printf(", ");
-        first = false;
-        
-        // And display the value of the cell number that was specified on the command line
-        printf("%d", frame[cellNumber]);
+        munmap((void*)base, sb.st_size);
+        throw;
     }
-    
-    // Terminate the line of text in the output
-    printf("\n");
+
+    // We're done with the mapping
+    if (base) munmap((void*)base, sb.st_size);
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// readConfigurationFile() - Reads in the configuration file and populates the global "config"
-//                           structure.
+// trace() - Displays the values of one or more cells for every frame in the output file
+//
+// When a single cell is traced, its values are printed on one line.  When more than one cell is
+// traced, each cell's values are printed on a line of their own, prefixed with the cell number.
+//
+// The values of a cell are printed as they're read, so tracing a single cell uses the same
+// memory no matter how large the file is.  Several cells are traced a group at a time, with a pass
+// through the file for each group, and no more than TRACE_MEMORY of their values are held while
+// a group is being read
 //=================================================================================================
-void readConfigurationFile(string filename)
+void trace(const vector<uint32_t>& cellList)
 {
-    CConfigFile cf;
+    const uint64_t TRACE_MEMORY = 64 << 20;
+
+    // This is the offset within a frame of each cell being traced
+    vector<uint32_t> offset = traceOffsets(cellList);
+
+    // Fetch the name of the file we're going to read, and find out how many frames it holds
+    const char* filename   = config.output_file.c_str();
+    uint64_t    frameCount = traceFrameCount(filename);
+
+    // How many cells are traced in each pass through the file?
+    size_t groupCells = max<uint64_t>(1, TRACE_MEMORY / max<uint64_t>(1, frameCount));
+
+    // If more than one cell is being traced, each line identifies which cell it's for
+    bool labelled = cellList.size() > 1;
+
+    for (size_t firstCell = 0; firstCell < cellList.size(); firstCell += groupCells)
+    {
+        size_t cells = min(groupCells, cellList.size() - firstCell);
+
+        // A lone cell's values are printed as each block of frames is read.  Otherwise, the values
+        // of the group's cells are gathered from every frame, then printed a cell at a time
+        vector<vector<uint8_t>> value(cells > 1 ? cells : 0);
+        for (auto& v : value) v.reserve(frameCount);
+        bool firstValue = true;
+        if (cells == 1 && labelled) printf("%u: ", cellList[firstCell]);
+        readFrameBlocks(filename, [&](uint32_t frames, const uint8_t* data)
+        {
+            for (uint32_t f=0; f<frames; ++f)
+            {
+                const uint8_t* frame = data + (size_t)f * config.cells_per_frame;
+                if (cells == 1)
+                {
+                    printf(firstValue ? "%d" : ", %d", frame[offset[firstCell]]);
+                    firstValue = false;
+                }
+                else for (size_t i=0; i<cells; ++i) value[i].push_back(frame[offset[firstCell + i]]);
+            }
+        });
+
+        // Terminate the lone cell's line of text
+        if (cells == 1)
+        {
+            printf("\n");
+            continue;
+        }
 
-    // Declare a default filename
-    const char* cfilename = "ecd_sample_prep.conf";
+        // Or display the values of each cell of the group, one line per cell
+        for (size_t i=0; i<cells; ++i)
+        {
+            printf("%u: ", cellList[firstCell + i]);
+            for (size_t f=0; f<value[i].size(); ++f) printf(f ? ", %d" : "%d", value[i][f]);
+            printf("\n");
+        }
+    }
+}
+//=================================================================================================
 
-    // If the filename passed by the caller isn't blank, that's our filename
-    if (!filename.empty()) cfilename = filename.c_str();
 
-    // Read and parse the configuration file and complain if we can't
-    if (!cf.read(cfilename, false)) throwRuntime("Can't read %s", cfilename);
+//=================================================================================================
+// writeAt() - Writes an entire buffer to a file at the specified offset
+//=================================================================================================
+static void writeAt(int fd, const void* data, size_t length, uint64_t offset, const char* filename)
+{
+    const uint8_t* p = (const uint8_t*)data;
 
-    // Fetch each configuration
-    cf.get("cells_per_frame",     &config.cells_per_frame    );
-    cf.get("contig_size",         &config.contig_size        );
-    cf.get("data_frames",         &config.data_frames        );
-    cf.get("diagnostic_values",   &config.diagnostic_values  );
-    cf.get("quiescent",           &config.quiescent          );
-    cf.get("fragment_file",       &config.fragment_file      );
-    cf.get("distribution_file",   &config.distribution_file  );
-    cf.get("output_file",         &config.output_file        );
+    while (length)
+    {
+        ssize_t written = pwrite(fd, p, length, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) throwRuntime("Can't write %s: %s", filename, strerror(errno));
+        p += written;
+        length -= written;
+        offset += written;
+    }
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// createLvdsTranslationTable() - Creates the translation table that re-arranges a row of data
-//                                so that it's in suitable order for transmission over ECD LVDS
+// exportTrace() - Extracts the values of a set of cells from every frame in the output file and
+//                 writes them to another file, either as a CSV matrix or as binary columns
+//
+// The output file is read sequentially in large blocks of whole frames.  The cells of each block
+// are gathered into one column per cell, and then those columns are written out:
+//
+//    Binary : Column 'i' (i.e., cell cellList[i]) occupies bytes [i*frameCount, (i+1)*frameCount)
+//    CSV    : A header line "frame,<cell>,<cell>,...", then one line per frame
 //=================================================================================================
-void createLvdsTranslationTable()
+void exportTrace(const vector<uint32_t>& cellList, string filename)
 {
-    // Each row of a frame consists of 2048 cells divided into 8 cell-groups
-    for (int group = 0; group <8; ++group)
+    // This is the offset within a frame of each cell being traced
+    vector<uint32_t> offset = traceOffsets(cellList);
+    size_t cellCount = offset.size();
+
+    // Are we creating a CSV file?
+    bool isCsv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+
+    // Open the file we're going to read, and complain if we can't.  A chunked file is read via
+    // its index, a run-length encoded file one run after another, and anything else is raw frames
+    const char* ifilename = config.output_file.c_str();
+    CChunkedReader chunked;
+    CRleReader rle;
+    bool isChunked = CChunkedReader::isChunkedFile(ifilename);
+    bool isRle     = !isChunked && CRleReader::isRleFile(ifilename);
+    int  ifd = -1;
+    if (isChunked)
+    {
+        chunked.open(ifilename);
+        if (chunked.frameSize() != config.cells_per_frame)
+        {
+            throwRuntime("%s has %u-byte frames, but cells_per_frame is %u", ifilename, chunked.frameSize(),
+                         config.cells_per_frame);
+        }
+    }
+    else if (isRle)
+    {
+        rle.open(ifilename);
+        if (rle.frameSize() != config.cells_per_frame)
+        {
+            throwRuntime("%s has %u-byte frames, but cells_per_frame is %u", ifilename, rle.frameSize(),
+                         config.cells_per_frame);
+        }
+    }
+    else
+    {
+        ifd = ::open(ifilename, O_RDONLY);
+        if (ifd < 0) throwRuntime("Can't open %s", ifilename);
+    }
+
+    // Create the file we're going to write
+    const char* ofilename = filename.c_str();
+    int ofd = ::open(ofilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (ofd < 0)
+    {
+        ::close(ifd);
+        throwRuntime("Can't create %s", ofilename);
+    }
+
+    // Find out how many complete frames are in the file, and tell the kernel we'll be reading
+    // the whole thing from front to back
+    uint64_t frameCount = isChunked ? chunked.frameCount() : isRle ? rle.frameCount() : 0;
+    if (ifd >= 0)
+    {
+        struct stat sb;
+        fstat(ifd, &sb);
+        frameCount = sb.st_size / config.cells_per_frame;
+        posix_fadvise(ifd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    // Read about 32 MB of frames at a time.  From a chunked file, that's a whole number of chunks
+    uint32_t blockFrames = max(1U, (32U << 20) / config.cells_per_frame);
+    if (isChunked) blockFrames = max(1U, blockFrames / chunked.chunkFrames()) * chunked.chunkFrames();
+    vector<uint8_t> block((size_t)blockFrames * config.cells_per_frame);
+
+    // For each cell, its values from every frame in the block
+    vector<uint8_t> column(cellCount * blockFrames);
+
+    // The decimal text of every possible cell value, for building CSV lines without printf
+    char   digits[256][4];
+    for (int i=0; i<256; ++i) sprintf(digits[i], "%d", i);
+    string text;
+
+    // This is where the next CSV text goes in the exported file
+    uint64_t csvOffset = 0;
+
+    try
     {
-        // Determine the offset (within a row) of the first cell in this group
-        int groupOffset = group * 256 + 63;
+        // A CSV file begins with a line of column headings
+        if (isCsv)
+        {
+            text = "frame";
+            for (uint32_t cellNumber : cellList) text += "," + to_string(cellNumber);
+            text += "\n";
+            writeAt(ofd, text.data(), text.size(), csvOffset, ofilename);
+            csvOffset += text.size();
+        }
 
-        // Each group consists of four rows of 64-cells each
-        for (int row=0; row < 4; ++row)
+        // Loop through each block of frames in the file
+        for (uint64_t blockStart = 0; blockStart < frameCount; blockStart += blockFrames)
         {
-            int rowOffset = groupOffset + (row * 64);
-            int cellValue = row * 512 + group;
+            // Read this block of frames
+            uint32_t frames = min<uint64_t>(blockFrames, frameCount - blockStart);
+            size_t   length = (size_t)frames * config.cells_per_frame;
+            uint64_t fileOffset = blockStart * config.cells_per_frame;
+            if (isChunked) chunked.read(blockStart, frames, block.data());
+            if (isRle) rle.read(frames, block.data());
+            for (size_t got = (ifd < 0) ? length : 0; got < length;)
+            {
+                ssize_t n = pread(ifd, block.data() + got, length - got, fileOffset + got);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) throwRuntime("Can't read %s", ifilename);
+                got += n;
+            }
+
+            // Gather the traced cells of each frame into their columns
+            for (uint32_t f=0; f<frames; ++f)
+            {
+                const uint8_t* frame = block.data() + (size_t)f * config.cells_per_frame;
+                for (size_t i=0; i<cellCount; ++i) column[i * blockFrames + f] = frame[offset[i]];
+            }
+
+            // In a binary file, each column of the block goes to its own place in the file
+            if (!isCsv)
+            {
+                for (size_t i=0; i<cellCount; ++i)
+                {
+                    writeAt(ofd, &column[i * blockFrames], frames, i * frameCount + blockStart, ofilename);
+                }
+                continue;
+            }
 
-            for (int i=0; i<64; ++i)
+            // Otherwise, build a line of CSV text for each frame in the block
+            text.clear();
+            for (uint32_t f=0; f<frames; ++f)
             {
-                lvdsTranslationTable[rowOffset - i] = cellValue;
-                cellValue = cellValue + 8;
+                text += to_string(blockStart + f);
+                for (size_t i=0; i<cellCount; ++i)
+                {
+                    text += ',';
+                    text += digits[column[i * blockFrames + f]];
+                }
+                text += '\n';
             }
-        }        
+            writeAt(ofd, text.data(), text.size(), csvOffset, ofilename);
+            csvOffset += text.size();
+        }
+    }
+    catch (...)
+    {
+        if (ifd >= 0) ::close(ifd);
+        ::close(ofd);
+        throw;
     }
+
+    // We're done with both files
+    if (ifd >= 0) ::close(ifd);
+    if (::close(ofd) < 0) throwRuntime("Can't write %s: %s", ofilename, strerror(errno));
+
+    // Tell the user what we did
+    printf("Exported %lu cells from %lu frames to %s\n", cellCount, frameCount, ofilename);
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// reorderForLvds() - Translates a frame of data into the order in which the ECD's LVDS logic
-//                    needs to transmit it to the FPGA
-//
-// Think of a row of cell data as existing in a "raw" order (i.e., the order that we think of it
-// logically being in), and an "lvds order", which is the order it has to be in so that the ECD
-// can transmit it to the FPGA over LVDS.
-//
-// The value 'x' at some given index 'i' in the translation table means:
-//    At location 'i' in the lvds-ordered row, you will find the value from location 'x' in the
-//    raw-ordered row.  Stated another way: lvds_order[i] = raw_order[x]
+// expandChunkedFile() - Expands the chunked output file into an ordinary output file.  Threads
+//                       claim chunks one at a time, and write each one to its place in the file
 //
+// Passed: filename = The name of the ordinary output file to create
 //=================================================================================================
-void reorderForLvds(uint8_t* rawFrame)
+void expandChunkedFile(string filename)
 {
-    uint8_t lvdsRow[ROW_SIZE];
-
-    // How many rows are in a frame of data?
-    int rowsPerFrame = config.cells_per_frame / ROW_SIZE;
-
-    // Loop through each row of data in the frame...
-    for (int row=0; row<rowsPerFrame; ++row)
+    CChunkedReader reader;
+    reader.open(config.output_file);
+
+    // Create the expanded file
+    const char* ofilename = filename.c_str();
+    int ofd = ::open(ofilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (ofd < 0) throwRuntime("Can't create %s", ofilename);
+
+    // Each thread expands chunks into a buffer of its own
+    uint64_t chunkBytes = (uint64_t)reader.chunkFrames() * reader.frameSize();
+    vector<string> failure;
+    mutex failureMutex;
+    atomic<uint64_t> nextChunk(0);
+    auto worker = [&]()
     {
-        // Create a pointer to this row of data within the frame
-        uint8_t* rawRow  = rawFrame + ROW_SIZE * row;
-    
-        // Translate this row of data from raw order to LVDS order
-        for (int i=0; i<ROW_SIZE; ++i) lvdsRow[i] = rawRow[lvdsTranslationTable[i]];
+        vector<uint8_t> chunk(chunkBytes);
+        for (uint64_t c = nextChunk++; c < reader.chunkCount(); c = nextChunk++)
+        {
+            try
+            {
+                reader.readChunk(c, chunk.data());
+                writeAt(ofd, chunk.data(), (size_t)reader.framesInChunk(c) * reader.frameSize(), c * chunkBytes, ofilename);
+            }
+            catch (const exception& e)
+            {
+                lock_guard<mutex> lock(failureMutex);
+                failure.push_back(e.what());
+                return;
+            }
+        }
+    };
 
-        // Copy the lvds-ordered data back into the original frame
-        memcpy(rawRow, lvdsRow, ROW_SIZE);
-    }
+    vector<thread> pool;
+    for (uint32_t i=1; i<cmdLine.threads; ++i) pool.push_back(thread(worker));
+    worker();
+    for (auto& t : pool) t.join();
+
+    // We're done with the expanded file
+    if (::close(ofd) < 0 && failure.empty()) failure.push_back(string("Can't write ") + ofilename);
+    if (!failure.empty()) throwRuntime("%s", failure[0].c_str());
 }
 //=================================================================================================
 
@@ -832,4 +2327,406 @@ void printLvdsMap()
 //=================================================================================================
 
 
+//=================================================================================================
+// writeSyntheticInputs() - Writes a fragment definitions file and a distribution definitions file
+//                          of the specified size, filled with pseudo-random (but repeatable) data
+//
+// Passed: recordCount    = The number of distribution records
+//         sequenceFrames = If this isn't 0, the length (in frames) of the longest fragment
+//                          sequence.  Every sequence is then padded out to a length between half
+//                          of this and all of it, using repeated fragments ("name*N") so that the
+//                          distribution file stays small however long the sequences are
+//=================================================================================================
+static void writeSyntheticInputs(uint32_t recordCount, uint32_t sequenceFrames = 0)
+{
+    const uint32_t fragmentCount = 1000;
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    vector<uint32_t> fragmentLength(fragmentCount);
+
+    // A simple repeatable pseudo-random number generator
+    auto random = [&](uint32_t range)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (uint32_t)((seed >> 33) % range);
+    };
+
+    // Write the fragment definitions: each fragment has between 1 and 64 values
+    FILE* ofile = fopen(config.fragment_file.c_str(), "w");
+    if (ofile == nullptr) throwRuntime("Can't create %s", config.fragment_file.c_str());
+    for (uint32_t i=0; i<fragmentCount; ++i)
+    {
+        fprintf(ofile, "f%u", i);
+        fragmentLength[i] = random(64) + 1;
+        for (uint32_t n = fragmentLength[i]; n; --n) fprintf(ofile, ", %u", random(256));
+        fprintf(ofile, "\n");
+    }
+
+    // Padded sequences are finished off with a fragment that's a single value
+    if (sequenceFrames) fprintf(ofile, "pad, %u\n", config.quiescent ^ 0xFF);
+    fclose(ofile);
+
+    // Write the distribution definitions: each record covers a strided range of cells with a
+    // sequence of between 1 and 6 fragments
+    ofile = fopen(config.distribution_file.c_str(), "w");
+    if (ofile == nullptr) throwRuntime("Can't create %s", config.distribution_file.c_str());
+    for (uint32_t i=0; i<recordCount; ++i)
+    {
+        uint32_t first = random(config.cells_per_frame) + 1;
+        uint32_t last  = min(config.cells_per_frame, first + random(config.cells_per_frame / 16));
+        fprintf(ofile, "%u, %u, %u $", first, last, random(8) + 1);
+
+        // If the sequences aren't being padded, this is the whole record
+        if (sequenceFrames == 0)
+        {
+            for (uint32_t n = random(6) + 1; n; --n) fprintf(ofile, " f%u%s", random(fragmentCount), n > 1 ? "," : "");
+            fprintf(ofile, "\n");
+            continue;
+        }
+
+        // The first record has the longest sequence, so that the file needs exactly sequenceFrames
+        uint32_t target = (i == 0) ? sequenceFrames : sequenceFrames / 2 + random(sequenceFrames / 2 + 1);
+        uint32_t length = 0;
+        const char* separator = "";
+
+        // Start the sequence with as many of its fragments as fit
+        for (uint32_t n = random(6) + 1; n; --n)
+        {
+            uint32_t f = random(fragmentCount);
+            if (length + fragmentLength[f] > target) break;
+            fprintf(ofile, "%s f%u", separator, f);
+            length += fragmentLength[f];
+            separator = ",";
+        }
+
+        // Then pad it out with one fragment repeated, and single values
+        uint32_t f      = random(fragmentCount);
+        uint32_t repeat = (target - length) / fragmentLength[f];
+        if (repeat)
+        {
+            fprintf(ofile, "%s f%u*%u", separator, f, repeat);
+            length += repeat * fragmentLength[f];
+            separator = ",";
+        }
+        if (length < target) fprintf(ofile, "%s pad*%u", separator, target - length);
+        fprintf(ofile, "\n");
+    }
+    fclose(ofile);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeSyntheticWorkload() - Writes a synthetic fragment_file and distribution_file with the
+//                            specified number of records, whose longest sequence fills every
+//                            frame group that will fit into contig_size
+//=================================================================================================
+void writeSyntheticWorkload(uint32_t recordCount)
+{
+    // How many frame groups will fit into the contig buffer?  A sequence always ends before the
+    // last data frame of the last frame group (see CFrameGenerator::frameGroupCount), so that's
+    // as long as the longest one can be
+    uint32_t frameGroupLength = config.diagnostic_values.size() + config.data_frames;
+    uint64_t frameGroupCount  = config.contig_size / config.cells_per_frame / frameGroupLength;
+    uint64_t sequenceFrames   = frameGroupCount * config.data_frames;
+    if (sequenceFrames) --sequenceFrames;
+    if (sequenceFrames == 0) throwRuntime("contig_size is too small to hold a frame group");
+    if (sequenceFrames > UINT32_MAX) throwRuntime("contig_size is too large for a synthetic workload");
+
+    writeSyntheticInputs(recordCount, sequenceFrames);
+
+    printf("Wrote %s and %s\n", config.fragment_file.c_str(), config.distribution_file.c_str());
+    printf("%'16u Distribution records\n", recordCount);
+    printf("%'16u Cells per frame\n", config.cells_per_frame);
+    printf("%'16lu Frames in the longest fragment sequence\n", sequenceFrames);
+    printf("%'16lu Frame group(s) required\n", frameGroupCount);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// runBenchmark() - Times each stage of frame generation and reports its throughput
+//
+// The synthetic input files, and the file written by the output back-end benchmarks, are created
+// alongside the configured output file and are deleted afterwards
+//=================================================================================================
+void runBenchmark(uint32_t recordCount)
+{
+    // The synthetic input files and the benchmark output file
+    string prefix = config.output_file + ".bench";
+    config.fragment_file     = prefix + ".fragments.csv";
+    config.distribution_file = prefix + ".distribution.csv";
+    string outputFile        = prefix + ".dat";
+
+    // This runs a benchmark stage and reports how long it took
+    auto stage = [&](const char* name, uint64_t frames, uint64_t bytes, function<void()> code)
+    {
+        auto start = chrono::steady_clock::now();
+        code();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds <= 0) seconds = 1e-9;
+        printf("%-28s %10lu %10.3f %14.0f %10.3f %12.0f\n", name, frames, seconds, 
+               frames / seconds, bytes / seconds / 1e9, frames ? seconds * 1e9 / frames : 0.0);
+    };
+
+    // Create the synthetic input files
+    writeSyntheticInputs(recordCount);
+    struct stat sb;
+    uint64_t inputBytes = 0;
+    if (stat(config.fragment_file.c_str(),     &sb) == 0) inputBytes += sb.st_size;
+    if (stat(config.distribution_file.c_str(), &sb) == 0) inputBytes += sb.st_size;
+
+    printf("Benchmark: %u records, %u cells per frame, %u thread(s)\n\n", 
+           recordCount, config.cells_per_frame, max(1U, cmdLine.threads));
+    printf("%-28s %10s %10s %14s %10s %12s\n", "Stage", "Frames", "Seconds", "Frames/s", "GB/s", "ns/frame");
+
+    // Time the parsing of the input files
+    generator.reset(new CFrameGenerator(config, generatorOptions()));
+    stage("parse", 0, inputBytes, [&]{generator->loadFragments(); generator->loadDistribution();});
+    remove(config.fragment_file.c_str());
+    remove(config.distribution_file.c_str());
+
+    // These are the data frames that get built by each stage
+    uint32_t frames     = max(1U, generator->longestSequence());
+    uint64_t frameBytes = (uint64_t)frames * config.cells_per_frame;
+    vector<uint8_t> raw(config.cells_per_frame), lvds(config.cells_per_frame);
+
+    // Time building data frames in raw order, in LVDS order, and incrementally
+    stage("build (raw order)", frames, frameBytes, [&]
+    {
+        frameBuilder_t fb;
+        for (uint32_t fn=0; fn<frames; ++fn) generator->buildFullDataFrame<false>(fb, raw.data(), fn);
+    });
+    stage("build (fused LVDS order)", frames, frameBytes, [&]
+    {
+        frameBuilder_t fb;
+        for (uint32_t fn=0; fn<frames; ++fn) generator->buildFullDataFrame<true>(fb, lvds.data(), fn);
+    });
+    stage("build (-delta)", frames, frameBytes, [&]
+    {
+        frameBuilder_t fb;
+        for (uint32_t fn=0; fn<frames; ++fn) generator->updateDeltaFrame<true>(fb, fn);
+    });
+
+    // Time each of the LVDS re-ordering kernels that this CPU supports.  Re-ordering doesn't
+    // depend on the contents of the frame, so the same frame is re-ordered over and over
+    uint32_t reorderFrames = max(frames, (uint32_t)((1ULL << 30) / config.cells_per_frame));
+    for (const char* name : {"table", "sse2", "avx2", "neon"})
+    {
+        lvdsKernel_t kernel;
+        try {kernel = selectLvdsKernel(name);} catch (const exception&) {continue;}
+        string title = string("reorder (") + name + ")";
+        stage(title.c_str(), reorderFrames, (uint64_t)reorderFrames * config.cells_per_frame, [&]
+        {
+            for (uint32_t i=0; i<reorderFrames; ++i)
+            {
+                for (uint32_t row=0; row < config.cells_per_frame; row += ROW_SIZE) kernel(&raw[row], &lvds[row]);
+            }
+        });
+    }
+
+    // Time generating every frame of the output file (with the current command line options),
+    // both on this thread and on the worker thread pool, throwing the results away
+    uint32_t frameGroupCount  = generator->frameGroupCount();
+    uint64_t totalFrames      = generator->frameCount();
+    uint64_t totalBytes       = totalFrames * config.cells_per_frame;
+    CDiscardWriter discard;
+    stage("generate (1 thread)", totalFrames, totalBytes, [&]{writeFrames(&discard, 0, frameGroupCount);});
+    if (cmdLine.threads > 1)
+    {
+        string title = "generate (" + to_string(cmdLine.threads) + " threads)";
+        stage(title.c_str(), totalFrames, totalBytes, [&]{writeFramesThreaded(&discard, 0, totalFrames);});
+    }
+
+    // Time each output back-end writing about 1 GB of frames to a file
+    uint64_t writeFrameCount = max<uint64_t>(1, (1ULL << 30) / config.cells_per_frame);
+    uint64_t writeBytes      = writeFrameCount * config.cells_per_frame;
+    string   savedMode       = config.output_mode;
+    for (const char* mode : {"stdio", "direct", "uring", "mmap"})
+    {
+        config.output_mode = mode;
+        string title = string("write (") + mode + ")";
+        stage(title.c_str(), writeFrameCount, writeBytes, [&]
+        {
+            unique_ptr<CFrameWriter> writer(openFrameWriter(outputFile, writeBytes, config));
+            uint8_t* base = writer->mappedBase();
+            for (uint64_t i=0; i<writeFrameCount; ++i)
+            {
+                if (base)
+                    memcpy(base + i * config.cells_per_frame, lvds.data(), config.cells_per_frame);
+                else
+                    writer->write(lvds.data(), config.cells_per_frame);
+            }
+            writer->close();
+        });
+        remove(outputFile.c_str());
+    }
+    config.output_mode = savedMode;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// runBatch() - Creates the output file of every job in a batch manifest
+//
+// The manifest is a configuration file whose "jobs" setting lists the names of the jobs.  Each
+// job is a [section] of the manifest that can set data_frames, diagnostic_values, quiescent,
+// contig_size, output_file, output_mode, output_format and write_buffer_size.  A setting that a
+// job doesn't mention comes from outside of any section of the manifest if it's there, and from
+// the ordinary configuration file if it isn't.
+//
+// The fragment and distribution definitions are loaded once and shared by every job, since none
+// of those settings affect them.  Jobs run concurrently on a pool of -threads threads, each job
+// building and writing its frames on the thread that runs it.  A job that fails doesn't stop the
+// others
+//=================================================================================================
+void runBatch(string manifest)
+{
+    CConfigFile cf;
+    vector<string> jobName;
+
+    // Read the manifest and fetch the list of jobs
+    if (!cf.read(manifest, false)) throwRuntime("Can't read %s", manifest.c_str());
+    cf.get("jobs", &jobName);
+    if (jobName.empty()) throwRuntime("%s doesn't list any jobs", manifest.c_str());
+
+    // Work out the configuration of each job
+    vector<config_t> job(jobName.size(), config);
+    cf.throw_on_fail(false);
+    for (size_t i=0; i<job.size(); ++i)
+    {
+        config_t& jc = job[i];
+        cf.set_current_section(jobName[i]);
+        if (cf.exists("data_frames"      )) cf.get("data_frames",       &jc.data_frames      );
+        if (cf.exists("diagnostic_values")) cf.get("diagnostic_values", &jc.diagnostic_values);
+        if (cf.exists("quiescent"        )) cf.get("quiescent",         &jc.quiescent        );
+        if (cf.exists("contig_size"      )) cf.get("contig_size",       &jc.contig_size      );
+        if (cf.exists("output_file"      )) cf.get("output_file",       &jc.output_file      );
+        if (cf.exists("output_mode"      )) cf.get("output_mode",       &jc.output_mode      );
+        if (cf.exists("output_format"    )) cf.get("output_format",     &jc.output_format    );
+        if (cf.exists("write_buffer_size")) cf.get("write_buffer_size", &jc.write_buffer_size);
+
+        // Every job has to write a file of its own
+        if (CStreamWriter::isStreamTarget(jc.output_file) || jc.output_mode == "contig")
+        {
+            throwRuntime("Batch job '%s' must write to an ordinary file", jobName[i].c_str());
+        }
+        for (size_t j=0; j<i; ++j) if (job[j].output_file == jc.output_file)
+        {
+            throwRuntime("Batch jobs '%s' and '%s' both write %s", jobName[j].c_str(), jobName[i].c_str(),
+                         jc.output_file.c_str());
+        }
+    }
+
+    // Load (or compile) the distribution just once
+    generator.reset(new CFrameGenerator(config, generatorOptions()));
+    generator->load();
+    reportOverlaps();
+
+    // Give every job a generator of its own that shares the loaded distribution, and make sure
+    // that each job's frames will fit into the contiguous buffer
+    vector<unique_ptr<CFrameGenerator>> jobGenerator;
+    for (size_t i=0; i<job.size(); ++i)
+    {
+        jobGenerator.emplace_back(new CFrameGenerator(job[i], *generator, generatorOptions()));
+        uint64_t bytes = jobGenerator[i]->frameCount() * job[i].cells_per_frame;
+        if (bytes > job[i].contig_size)
+        {
+            throwRuntime("Batch job '%s' needs %lu bytes, which won't fit into the contig buffer",
+                         jobName[i].c_str(), bytes);
+        }
+    }
+
+    // The jobs that have failed, and why
+    vector<string> failure(job.size());
+    atomic<size_t> nextJob(0);
+
+    // Each thread in the pool runs one job after another until there are none left
+    auto worker = [&]()
+    {
+        for (size_t i = nextJob++; i < job.size(); i = nextJob++)
+        {
+            auto start = chrono::steady_clock::now();
+            try
+            {
+                writeBatchJob(job[i], *jobGenerator[i]);
+            }
+            catch (const exception& e)
+            {
+                failure[i] = e.what();
+                printf("Batch job '%s' failed: %s\n", jobName[i].c_str(), e.what());
+                fflush(stdout);
+                continue;
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            printf("Batch job '%s' wrote %'lu frames to %s in %.1f seconds\n", jobName[i].c_str(),
+                   jobGenerator[i]->frameCount(), job[i].output_file.c_str(), seconds);
+            fflush(stdout);
+        }
+    };
+
+    // Run the jobs
+    vector<thread> pool;
+    uint32_t workerCount = max(1U, min<uint32_t>(cmdLine.threads, job.size()));
+    printf("Running %lu batch jobs on %u thread(s)\n", job.size(), workerCount);
+    fflush(stdout);
+    for (uint32_t i=1; i<workerCount; ++i) pool.push_back(thread(worker));
+    worker();
+    for (auto& t : pool) t.join();
+
+    // Tell the caller if any of the jobs failed
+    size_t failures = count_if(failure.begin(), failure.end(), [](const string& s) {return !s.empty();});
+    if (failures) throwRuntime("%lu of %lu batch jobs failed", failures, job.size());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeBatchJob() - Creates the output file of a single batch job
+//
+// Passed: settings     = The job's configuration
+//         jobGenerator = The generator that builds the job's frames
+//=================================================================================================
+void writeBatchJob(const config_t& settings, const CFrameGenerator& jobGenerator)
+{
+    uint64_t totalFrames = jobGenerator.frameCount();
+    uint32_t frameSize   = jobGenerator.frameSize();
+
+    // Create the output file, and checksum each frame group as it's written
+    unique_ptr<CFrameWriter> writer(openFrameWriter(settings.output_file, totalFrames * frameSize, settings));
+    CChecksumWriter* checksummer = nullptr;
+    if (settings.checksums)
+    {
+        checksummer = new CChecksumWriter(writer.release(), (uint64_t)jobGenerator.frameGroupLength() * frameSize, 0);
+        writer.reset(checksummer);
+    }
+
+    // If the output file is mapped into memory, frames get built directly into it.  Otherwise,
+    // they're built a batch of about 4 MB at a time and written
+    if (writer->mappedBase())
+    {
+        jobGenerator.fill(0, totalFrames, writer->mappedBase());
+        if (checksummer) checksummer->checksumMapped(totalFrames * frameSize, 1);
+    }
+    else
+    {
+        uint32_t batchFrames = max(1U, (4 * 1024 * 1024) / frameSize);
+        vector<uint8_t> batch((size_t)batchFrames * frameSize);
+        frameBuilder_t fb;
+        for (uint64_t frameIndex = 0; frameIndex < totalFrames;)
+        {
+            uint64_t frames = min<uint64_t>(batchFrames, totalFrames - frameIndex);
+            for (uint64_t i=0; i<frames; ++i)
+            {
+                jobGenerator.buildFrame(fb, batch.data() + i * frameSize, frameIndex + i);
+            }
+            writer->write(batch.data(), frames * frameSize);
+            frameIndex += frames;
+        }
+    }
+    writer->close();
+    if (checksummer) writeChecksumFile(settings.output_file + ".crc", settings.output_file, checksummer->checksums());
 
+    // Keep a record of the distribution, so that the output file can be updated with -update
+    saveOutputRecord(settings, jobGenerator);
+}
+//=================================================================================================
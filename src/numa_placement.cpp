@@ -0,0 +1,233 @@
+//==========================================================================================================
+// numa_placement.cpp - Implements NUMA placement of worker threads, and huge-page frame buffers
+//==========================================================================================================
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <stdexcept>
+#include <fstream>
+#include "numa_placement.h"
+
+using namespace std;
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+
+//==========================================================================================================
+// parseHugePages() - Converts a page kind from the command line to a hugePages_t
+//==========================================================================================================
+hugePages_t parseHugePages(string name)
+{
+    if (name == "none") return HUGE_NONE;
+    if (name == "thp" ) return HUGE_THP;
+    if (name == "2M" || name == "2m") return HUGE_2MB;
+    if (name == "1G" || name == "1g") return HUGE_1GB;
+    throw runtime_error("Unknown huge page size '" + name + "' (expected 2M, 1G, thp or none)");
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// hugePagesName() - Returns a human readable name for a hugePages_t
+//==========================================================================================================
+static const char* hugePagesName(hugePages_t kind)
+{
+    switch (kind)
+    {
+        case HUGE_THP: return "transparent huge pages";
+        case HUGE_2MB: return "2 MB huge pages";
+        case HUGE_1GB: return "1 GB huge pages";
+        default:       return "ordinary pages";
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// parseCpuList() - Parses a Linux CPU list such as "0-3,8-11" into a list of CPU numbers
+//==========================================================================================================
+static vector<int> parseCpuList(const string& text)
+{
+    vector<int> result;
+    const char* p = text.c_str();
+
+    while (*p)
+    {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) result.push_back(cpu);
+        if (*p == ',') ++p;
+    }
+
+    return result;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// init() - Reads the NUMA topology.  Nodes without CPUs (memory-only nodes) are ignored
+//==========================================================================================================
+void CNumaPlacement::init(bool pinWorkers, hugePages_t hugePages)
+{
+    m_pinWorkers = pinWorkers;
+    m_hugePages  = m_requested = hugePages;
+    m_nodes.clear();
+
+    // Find out whether the huge page pool can actually supply the pages that were asked for
+    if (hugePages == HUGE_2MB || hugePages == HUGE_1GB)
+    {
+        CFrameBuffer probe;
+        probe.allocate(1, hugePages);
+        m_hugePages = probe.kind();
+    }
+
+    // Node numbers can have gaps, so look at every possible one that the kernel declares
+    string possible;
+    ifstream("/sys/devices/system/node/possible") >> possible;
+    for (int number : parseCpuList(possible))
+    {
+        string cpulist;
+        ifstream("/sys/devices/system/node/node" + to_string(number) + "/cpulist") >> cpulist;
+        vector<int> cpus = parseCpuList(cpulist);
+        if (!cpus.empty()) m_nodes.push_back({number, cpus});
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// workerNode() - Returns the node that a worker runs on.  Workers are dealt out round-robin, so that
+//                consecutive workers land on different nodes
+//==========================================================================================================
+int CNumaPlacement::workerNode(uint32_t worker) const
+{
+    if (!m_pinWorkers || m_nodes.empty()) return -1;
+    return m_nodes[worker % m_nodes.size()].number;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// pinWorker() - Restricts the calling thread to the CPUs of its worker's node, and makes that node the
+//               preferred source of the memory it touches
+//==========================================================================================================
+void CNumaPlacement::pinWorker(uint32_t worker) const
+{
+    if (!m_pinWorkers || m_nodes.empty()) return;
+
+    const node_t& node = m_nodes[worker % m_nodes.size()];
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu : node.cpus) if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof cpuset, &cpuset);
+
+    // Failure here only costs performance, so it isn't treated as an error
+    unsigned long mask[16] = {0};
+    if (node.number < (int)(8 * sizeof mask))
+    {
+        mask[node.number / (8 * sizeof(long))] |= 1UL << (node.number % (8 * sizeof(long)));
+        syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, 8 * sizeof mask);
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// description() - Describes the placement that's in effect, for the startup report
+//==========================================================================================================
+string CNumaPlacement::description() const
+{
+    string result = to_string(nodeCount()) + (nodeCount() == 1 ? " NUMA node" : " NUMA nodes");
+    result += m_pinWorkers ? ", workers pinned per node" : ", workers not pinned";
+    result += string(", frame buffers from ") + hugePagesName(m_hugePages);
+    if (m_hugePages != m_requested) result += string(" (") + hugePagesName(m_requested) + " unavailable)";
+    return result;
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// allocate() - Maps a buffer.   Huge pages from the pool are tried first (if asked for), and if the pool
+//              doesn't have enough, ordinary pages are mapped and the kernel is asked to back them with
+//              transparent huge pages.  The node preference is set before anything touches the pages
+//==========================================================================================================
+void CFrameBuffer::allocate(size_t size, hugePages_t hugePages, int node)
+{
+    release();
+    if (size == 0) return;
+
+    void* p = MAP_FAILED;
+
+    // Try the huge page pool.  The mapping has to be a whole number of huge pages
+    if (hugePages == HUGE_2MB || hugePages == HUGE_1GB)
+    {
+        size_t pageSize = (hugePages == HUGE_2MB) ? (2UL << 20) : (1UL << 30);
+        int    flag     = (hugePages == HUGE_2MB) ? MAP_HUGE_2MB : MAP_HUGE_1GB;
+        m_mapped = (size + pageSize - 1) / pageSize * pageSize;
+        p = mmap(nullptr, m_mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flag, -1, 0);
+        if (p != MAP_FAILED) m_kind = hugePages;
+    }
+
+    // Otherwise, use ordinary pages
+    if (p == MAP_FAILED)
+    {
+        m_mapped = size;
+        p = mmap(nullptr, m_mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+        {
+            throw runtime_error(string("Can't allocate frame buffer: ") + strerror(errno));
+        }
+        m_kind = HUGE_NONE;
+        if (hugePages != HUGE_NONE && madvise(p, m_mapped, MADV_HUGEPAGE) == 0) m_kind = HUGE_THP;
+    }
+
+    // Ask for the pages to come from the preferred node.  Failure only costs performance
+    if (node >= 0 && node < 1024)
+    {
+        unsigned long mask[16] = {0};
+        mask[node / (8 * sizeof(long))] |= 1UL << (node % (8 * sizeof(long)));
+        syscall(SYS_mbind, p, m_mapped, MPOL_PREFERRED, mask, 8 * sizeof mask, 0);
+    }
+
+    m_data = (uint8_t*)p;
+    m_size = size;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// release() - Unmaps the buffer
+//==========================================================================================================
+void CFrameBuffer::release()
+{
+    if (m_data) munmap(m_data, m_mapped);
+    m_data = nullptr;
+    m_size = m_mapped = 0;
+    m_kind = HUGE_NONE;
+}
+//==========================================================================================================
@@ -0,0 +1,115 @@
+//==========================================================================================================
+// numa_placement.h - Defines how worker threads are placed on NUMA nodes, and the page-backed buffers
+//                    (optionally made of huge pages on a particular node) that they build frames in
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+
+//----------------------------------------------------------------------------------------------------------
+// hugePages_t - The kind of pages that frame buffers are made of
+//----------------------------------------------------------------------------------------------------------
+enum hugePages_t
+{
+    HUGE_NONE,          // Ordinary pages
+    HUGE_THP,           // Ordinary pages, with the kernel asked to back them with transparent huge pages
+    HUGE_2MB,           // 2 MB pages from the huge page pool, falling back to HUGE_THP
+    HUGE_1GB            // 1 GB pages from the huge page pool, falling back to HUGE_THP
+};
+
+// Converts "none", "thp", "2M" or "1G" to a hugePages_t.   Can throw exception runtime_error
+hugePages_t parseHugePages(std::string name);
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CNumaPlacement - Knows the NUMA topology of the machine (from /sys/devices/system/node), and which node
+//                  each worker thread should run on.  Workers are spread round-robin across the nodes that
+//                  have CPUs
+//----------------------------------------------------------------------------------------------------------
+class CNumaPlacement
+{
+public:
+
+    CNumaPlacement() {m_pinWorkers = false; m_hugePages = m_requested = HUGE_NONE;}
+
+    // Reads the topology.  If 'pinWorkers' is true, workers will be pinned to the CPUs of their node,
+    // and their buffers placed in that node's memory.  If 'hugePages' asks for pages from the huge
+    // page pool and the pool is empty, transparent huge pages are used instead
+    void        init(bool pinWorkers, hugePages_t hugePages);
+
+    // True if workers are being pinned to nodes
+    bool        pinning() const {return m_pinWorkers;}
+
+    // The kind of pages that frame buffers will be made of
+    hugePages_t hugePages() const {return m_hugePages;}
+
+    // The number of nodes that have CPUs (at least 1, even if the topology can't be read)
+    uint32_t    nodeCount() const {return m_nodes.empty() ? 1 : m_nodes.size();}
+
+    // The node that a worker runs on, or -1 if workers aren't pinned
+    int         workerNode(uint32_t worker) const;
+
+    // Pins the calling thread to the CPUs of the node that worker 'worker' runs on.  Does nothing if
+    // workers aren't pinned
+    void        pinWorker(uint32_t worker) const;
+
+    // A human readable description of the placement that's in effect
+    std::string description() const;
+
+protected:
+
+    // A node that has CPUs: its node number and its CPU numbers
+    struct node_t
+    {
+        int              number;
+        std::vector<int> cpus;
+    };
+
+    std::vector<node_t> m_nodes;
+    bool                m_pinWorkers;
+    hugePages_t         m_hugePages, m_requested;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CFrameBuffer - A block of memory obtained straight from the kernel with mmap(), which can be made of huge
+//                pages and can prefer the memory of a particular NUMA node
+//----------------------------------------------------------------------------------------------------------
+class CFrameBuffer
+{
+public:
+
+    CFrameBuffer() {m_data = nullptr; m_size = m_mapped = 0; m_kind = HUGE_NONE;}
+    ~CFrameBuffer() {release();}
+
+    CFrameBuffer(const CFrameBuffer&) = delete;
+    CFrameBuffer& operator=(const CFrameBuffer&) = delete;
+
+    // Allocates 'size' bytes.  If 'node' isn't -1, the pages come from that node's memory if possible.
+    // If huge pages were asked for and there aren't enough of them, the buffer is made of ordinary
+    // pages and transparent huge pages are requested instead.   Can throw exception runtime_error
+    void        allocate(size_t size, hugePages_t hugePages, int node = -1);
+
+    // Frees the buffer
+    void        release();
+
+    uint8_t*    data() const {return m_data;}
+    size_t      size() const {return m_size;}
+
+    // The kind of pages the buffer actually ended up being made of
+    hugePages_t kind() const {return m_kind;}
+
+protected:
+
+    uint8_t*    m_data;
+    size_t      m_size, m_mapped;
+    hugePages_t m_kind;
+};
+//----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,199 @@
+//==========================================================================================================
+// progress_monitor.cpp - Implements progress, ETA and throughput reporting
+//==========================================================================================================
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include "progress_monitor.h"
+
+using namespace std;
+using namespace std::chrono;
+
+
+//==========================================================================================================
+// start() - Resets the counters and starts the background thread that makes the periodic reports
+//==========================================================================================================
+void CProgressMonitor::start(uint64_t totalFrames, uint32_t frameSize, double interval, string statsFile)
+{
+    // Stop any previous run
+    halt();
+
+    m_totalFrames = totalFrames;
+    m_frameSize   = frameSize;
+    m_interval    = interval;
+    m_frames      = 0;
+    m_ioNanos     = 0;
+
+    // Create the stats file, if we've been asked for one
+    if (!statsFile.empty())
+    {
+        m_file = fopen(statsFile.c_str(), "w");
+        if (m_file == nullptr)
+        {
+            throw runtime_error("Can't create " + statsFile + ": " + strerror(errno));
+        }
+    }
+
+    // Start the clock, and if there are going to be periodic reports, start the thread that makes them
+    m_startTime = steady_clock::now();
+    if (m_interval > 0)
+    {
+        m_running = true;
+        m_thread  = thread(&CProgressMonitor::reporterThread, this);
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// stop() - Stops the periodic reports and makes the final one
+//==========================================================================================================
+void CProgressMonitor::stop()
+{
+    stopThread();
+    report(true);
+    halt();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// halt() - Stops the background thread and closes the stats file
+//==========================================================================================================
+void CProgressMonitor::halt()
+{
+    stopThread();
+    if (m_file) fclose(m_file);
+    m_file = nullptr;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// stopThread() - Tells the background thread to quit, and waits for it to do so
+//==========================================================================================================
+void CProgressMonitor::stopThread()
+{
+    if (!m_thread.joinable()) return;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_cvQuit.notify_all();
+    m_thread.join();
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// reporterThread() - Makes a report every 'm_interval' seconds until told to stop
+//==========================================================================================================
+void CProgressMonitor::reporterThread()
+{
+    auto nextReport = m_startTime;
+
+    unique_lock<mutex> lock(m_mutex);
+    while (true)
+    {
+        // Wait until it's time for the next report, or until we're told to quit
+        nextReport += duration_cast<steady_clock::duration>(duration<double>(m_interval));
+        if (m_cvQuit.wait_until(lock, nextReport, [&]{return !m_running;})) break;
+        report(false);
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// report() - Displays the progress so far and appends it to the stats file
+//
+// The stats file gets integers only, so its contents don't depend on the locale
+//==========================================================================================================
+void CProgressMonitor::report(bool done)
+{
+    // Fetch the counters
+    uint64_t frames  = m_frames.load(memory_order_relaxed);
+    uint64_t ioNanos = m_ioNanos.load(memory_order_relaxed);
+
+    // Figure out the elapsed time, and how much of it was compute time rather than I/O
+    uint64_t elapsedNanos = duration_cast<nanoseconds>(steady_clock::now() - m_startTime).count();
+    if (ioNanos > elapsedNanos) ioNanos = elapsedNanos;
+    uint64_t computeNanos = elapsedNanos - ioNanos;
+
+    // Compute the throughput and, from that, the estimated time to completion
+    uint64_t bytes       = frames * m_frameSize;
+    double   seconds     = elapsedNanos / 1e9;
+    double   bytesPerSec = seconds > 0 ? bytes / seconds : 0;
+    double   framesPerSec= seconds > 0 ? frames / seconds : 0;
+    uint64_t remaining   = m_totalFrames > frames ? m_totalFrames - frames : 0;
+    uint64_t eta         = framesPerSec > 0 ? (uint64_t)(remaining / framesPerSec + 0.5) : 0;
+    bool     haveEta     = (frames > 0);
+    double   percent     = m_totalFrames ? 100.0 * frames / m_totalFrames : 100.0;
+    double   ioPercent   = elapsedNanos ? 100.0 * ioNanos / elapsedNanos : 0;
+
+    // Display the report
+    if (m_interval > 0)
+    {
+        if (done)
+        {
+            printf("Wrote %'lu frames in %.1f seconds, %.1f MB/s, %.0f%% of the time blocked on I/O\n",
+                   frames, seconds, bytesPerSec / 1e6, ioPercent);
+        }
+        else
+        {
+            // Until the first frame is written, there's no way to estimate the time remaining
+            char etaText[32] = "?:??:??";
+            if (haveEta) sprintf(etaText, "%lu:%02lu:%02lu", eta / 3600, eta / 60 % 60, eta % 60);
+            printf("%5.1f%%  %'lu of %'lu frames  %.1f MB/s  ETA %s  I/O %.0f%%  compute %.0f%%\n",
+                   percent, frames, m_totalFrames, bytesPerSec / 1e6, etaText, ioPercent, 100 - ioPercent);
+        }
+        fflush(stdout);
+    }
+
+    // Append it to the stats file
+    if (m_file)
+    {
+        string etaText = haveEta ? to_string(eta) : "null";
+        fprintf(m_file, "{\"elapsed_ms\": %lu, \"frames\": %lu, \"total_frames\": %lu, \"bytes\": %lu, "
+                        "\"bytes_per_sec\": %lu, \"eta_sec\": %s, \"io_ms\": %lu, \"compute_ms\": %lu, "
+                        "\"done\": %s}\n",
+                elapsedNanos / 1000000, frames, m_totalFrames, bytes, (uint64_t)bytesPerSec, etaText.c_str(),
+                ioNanos / 1000000, computeNanos / 1000000, done ? "true" : "false");
+        fflush(m_file);
+    }
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// CMonitoredWriter::write() - Writes data via the inner back-end, and reports the frames and the time
+//==========================================================================================================
+void CMonitoredWriter::write(const uint8_t* data, size_t length)
+{
+    auto start = steady_clock::now();
+    m_inner->write(data, length);
+    m_monitor->addIoTime(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+
+    // Count the frames that have been completed
+    m_partial += length;
+    if (m_partial >= m_frameSize)
+    {
+        m_monitor->addFrames(m_partial / m_frameSize);
+        m_partial %= m_frameSize;
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// CMonitoredWriter::close() - Closes the inner back-end.  Flushing it counts as I/O time
+//==========================================================================================================
+void CMonitoredWriter::close()
+{
+    auto start = steady_clock::now();
+    m_inner->close();
+    m_monitor->addIoTime(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+}
+//==========================================================================================================
@@ -0,0 +1,115 @@
+//==========================================================================================================
+// progress_monitor.h - Defines the progress, ETA and throughput reporting used while writing frames
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "frame_writer.h"
+
+
+//----------------------------------------------------------------------------------------------------------
+// CProgressMonitor - Keeps count of the frames that have been written and how long has been spent blocked
+//                    on I/O, and periodically reports them from a background thread.
+//
+// The counters are updated with relaxed atomic adds, so the threads doing the work never wait on the
+// reporter.  Each report is displayed as a line of text and, optionally, appended to a stats file as a
+// line of JSON.  "Compute" time is whatever part of the elapsed time wasn't spent blocked on I/O
+//----------------------------------------------------------------------------------------------------------
+class CProgressMonitor
+{
+public:
+
+    CProgressMonitor() {m_file = nullptr; m_running = false; m_interval = 0;}
+    ~CProgressMonitor() {halt();}
+
+    // Call this just before the first frame is written.  A report is made every 'interval' seconds
+    // (0 means no periodic reports).  If 'statsFile' isn't empty, each report is also appended to it
+    // as a line of JSON.   Can throw exception runtime_error
+    void    start(uint64_t totalFrames, uint32_t frameSize, double interval, std::string statsFile);
+
+    // Call this to record that frames have been written
+    void    addFrames(uint64_t count) {m_frames.fetch_add(count, std::memory_order_relaxed);}
+
+    // Call this to record time spent blocked on I/O
+    void    addIoTime(uint64_t nanoseconds) {m_ioNanos.fetch_add(nanoseconds, std::memory_order_relaxed);}
+
+    // Call this after the last frame has been written.  It stops the reports and makes a final one
+    void    stop();
+
+protected:
+
+    // Stops the background thread and closes the stats file, without a final report
+    void    halt();
+
+    // Tells the background thread to quit, and waits for it to do so
+    void    stopThread();
+
+    // This is the code that runs in the background thread
+    void    reporterThread();
+
+    // Displays and records the current progress
+    void    report(bool done);
+
+    // How many frames are being written, and how many bytes are in each of them
+    uint64_t    m_totalFrames;
+    uint32_t    m_frameSize;
+
+    // How many seconds there are between reports
+    double      m_interval;
+
+    // The JSON-lines stats file, if there is one
+    FILE*       m_file;
+
+    // When we started
+    std::chrono::steady_clock::time_point m_startTime;
+
+    // The frames written so far, and the total time spent blocked on I/O
+    std::atomic<uint64_t> m_frames, m_ioNanos;
+
+    // The background thread, and what it uses to know when it's time to quit
+    std::thread             m_thread;
+    bool                    m_running;
+    std::mutex              m_mutex;
+    std::condition_variable m_cvQuit;
+};
+//----------------------------------------------------------------------------------------------------------
+
+
+
+//----------------------------------------------------------------------------------------------------------
+// CMonitoredWriter - Wraps an open back-end, and reports every frame written through it (along with the
+//                    time spent in the back-end) to a CProgressMonitor
+//----------------------------------------------------------------------------------------------------------
+class CMonitoredWriter : public CFrameWriter
+{
+public:
+
+    // 'inner' is an open back-end and is owned by this object
+    CMonitoredWriter(CFrameWriter* inner, uint32_t frameSize, CProgressMonitor* monitor)
+        : m_inner(inner) {m_frameSize = frameSize; m_monitor = monitor; m_partial = 0;}
+
+    void     open(std::string filename, uint64_t totalBytes) {m_inner->open(filename, totalBytes);}
+    void     write(const uint8_t* data, size_t length);
+    void     close();
+    uint8_t* mappedBase() {return m_inner->mappedBase();}
+
+protected:
+
+    // The back-end that actually writes the data
+    std::unique_ptr<CFrameWriter> m_inner;
+
+    // The number of bytes in a frame, and how many bytes of a partial frame have been written
+    uint32_t    m_frameSize;
+    uint64_t    m_partial;
+
+    // Where the frames and I/O time get reported
+    CProgressMonitor* m_monitor;
+};
+//----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,450 @@
+//==========================================================================================================
+// uring_writer.cpp - Implements the back-end that writes the output file asynchronously via io_uring
+//==========================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include "uring_writer.h"
+#include "errors.h"
+
+using namespace std;
+
+// O_DIRECT requires buffers, lengths and file offsets to be aligned to this many bytes
+static const size_t DIRECT_ALIGN = 4096;
+
+
+//==========================================================================================================
+// The io_uring system calls.  glibc doesn't wrap them
+//==========================================================================================================
+static int uringSetup(uint32_t entries, io_uring_params* params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+{
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int uringRegister(int fd, uint32_t opcode, const void* arg, uint32_t count)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+//==========================================================================================================
+
+
+
+//==========================================================================================================
+// CUringWriter() - Constructor.  Allocates the aligned buffers
+//==========================================================================================================
+CUringWriter::CUringWriter(size_t bufferSize, uint32_t queueDepth)
+{
+    // Round the buffer size up to a multiple of the O_DIRECT alignment
+    m_bufferSize = (bufferSize + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    if (m_bufferSize == 0) m_bufferSize = DIRECT_ALIGN;
+
+    // We need at least two buffers: one being filled and one being written
+    m_queueDepth = max(2U, queueDepth);
+
+    // We don't have a ring or an output file yet
+    m_fd         = -1;
+    m_ringFd     = -1;
+    m_sqRing     = m_cqRing = nullptr;
+    m_sqes       = nullptr;
+    m_inFlight   = 0;
+    m_ioError    = 0;
+    m_fixedBuffers = m_fixedFile = false;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// ~CUringWriter() - Destructor.  Waits for any writes in flight, then frees everything
+//==========================================================================================================
+CUringWriter::~CUringWriter()
+{
+    // The kernel may still be reading from the buffers
+    if (m_ringFd >= 0) drain();
+    releaseRing();
+
+    if (m_fd >= 0) ::close(m_fd);
+    for (auto p : m_buffer) free(p);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// open() - Sets up the ring, then creates and preallocates the output file.  If the kernel doesn't
+//          support io_uring, the output file is written by a CDirectWriter instead
+//==========================================================================================================
+void CUringWriter::open(string filename, uint64_t totalBytes)
+{
+    // Create the ring.  If we can't, fall back to blocking writes
+    int error = setupRing();
+    if (error)
+    {
+        printf("io_uring isn't available (%s), using blocking writes\n", strerror(error));
+        m_fallback.reset(new CDirectWriter(m_bufferSize));
+        m_fallback->open(filename, totalBytes);
+        return;
+    }
+
+    // Try to open the output file for direct I/O
+    m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+    m_isDirect = (m_fd >= 0);
+
+    // Some file-systems (tmpfs, for instance) don't support O_DIRECT.  Fall back to buffered I/O
+    if (m_fd < 0 && errno == EINVAL)
+    {
+        printf("O_DIRECT isn't supported for %s, using buffered I/O\n", filename.c_str());
+        m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+
+    // If we couldn't create the output file, complain
+    if (m_fd < 0) throwErrno("Can't create", filename, errno);
+
+    // Allocate all of the disk space up front, so that writes in flight never wait on the allocator.
+    // If the file-system can't do that, the writes will simply extend the file
+    error = posix_fallocate(m_fd, 0, totalBytes);
+    if (error && error != EOPNOTSUPP && error != EINVAL)
+    {
+        throwErrno("Can't allocate space for", filename, error);
+    }
+
+    // Allocate the buffers on an aligned boundary.  Every one of them starts out free
+    m_request.resize(m_queueDepth);
+    m_iov.resize(m_queueDepth);
+    for (uint32_t i=0; i<m_queueDepth; ++i)
+    {
+        void* p = nullptr;
+        if (posix_memalign(&p, DIRECT_ALIGN, m_bufferSize) != 0) throw runtime_error("Out of memory");
+        m_buffer.push_back((uint8_t*)p);
+        m_iov[i] = {p, m_bufferSize};
+        m_free.push_back(m_queueDepth - 1 - i);
+    }
+
+    // Let the kernel pin the buffers and the file once, rather than on every write
+    registerResources();
+
+    // Nothing has been buffered or written yet
+    m_fillIndex  = m_free.back();
+    m_free.pop_back();
+    m_fillLength = 0;
+    m_fileOffset = 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// setupRing() - Creates the ring and maps its submission queue, completion queue and SQE array
+//
+// Returns: 0 on success, otherwise the value of errno
+//==========================================================================================================
+int CUringWriter::setupRing()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+
+    m_ringFd = uringSetup(m_queueDepth, &params);
+    if (m_ringFd < 0) return errno;
+
+    // The sizes of the two queues.  On newer kernels, both live in the same mapping
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize = params.cq_off.cqes  + params.cq_entries * sizeof(io_uring_cqe);
+    bool single  = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) m_sqRingSize = m_cqRingSize = max(m_sqRingSize, m_cqRingSize);
+
+    // Map the submission queue
+    void* p = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+    if (p == MAP_FAILED) {int error = errno; releaseRing(); return error;}
+    m_sqRing = p;
+
+    // Map the completion queue
+    if (single)
+        m_cqRing = nullptr;
+    else
+    {
+        p = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+        if (p == MAP_FAILED) {int error = errno; releaseRing(); return error;}
+        m_cqRing = p;
+    }
+
+    // Map the array of submission queue entries
+    m_sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+    p = mmap(nullptr, m_sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+    if (p == MAP_FAILED) {int error = errno; releaseRing(); return error;}
+    m_sqes = (io_uring_sqe*)p;
+
+    // Find the parts of each queue that we need
+    uint8_t* sq = (uint8_t*)m_sqRing;
+    uint8_t* cq = (uint8_t*)(single ? m_sqRing : m_cqRing);
+    m_sqTail  = (uint32_t*)(sq + params.sq_off.tail);
+    m_sqMask  = (uint32_t*)(sq + params.sq_off.ring_mask);
+    m_sqArray = (uint32_t*)(sq + params.sq_off.array);
+    m_cqHead  = (uint32_t*)(cq + params.cq_off.head);
+    m_cqTail  = (uint32_t*)(cq + params.cq_off.tail);
+    m_cqMask  = (uint32_t*)(cq + params.cq_off.ring_mask);
+    m_cqes    = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// registerResources() - Registers the buffers and the output file with the ring.  Neither is required,
+//                       so failure just means slightly more work for the kernel on each write
+//==========================================================================================================
+void CUringWriter::registerResources()
+{
+    m_fixedBuffers = (uringRegister(m_ringFd, IORING_REGISTER_BUFFERS, m_iov.data(), m_queueDepth) == 0);
+    if (!m_fixedBuffers)
+    {
+        printf("io_uring buffers couldn't be registered (%s), using unregistered buffers\n", strerror(errno));
+    }
+
+    m_fixedFile = (uringRegister(m_ringFd, IORING_REGISTER_FILES, &m_fd, 1) == 0);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// write() - Gathers data into the fill-buffer, submitting the buffer each time it fills up
+//==========================================================================================================
+void CUringWriter::write(const uint8_t* data, size_t length)
+{
+    if (m_fallback) {m_fallback->write(data, length); return;}
+
+    while (length)
+    {
+        // How many bytes of this data will fit into the fill-buffer?
+        size_t chunk = m_bufferSize - m_fillLength;
+        if (chunk > length) chunk = length;
+
+        // Append that data to the fill-buffer
+        memcpy(m_buffer[m_fillIndex] + m_fillLength, data, chunk);
+        m_fillLength += chunk;
+        data         += chunk;
+        length       -= chunk;
+
+        // If the fill-buffer is full, hand it to the kernel to be written
+        if (m_fillLength == m_bufferSize) submitFillBuffer();
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// close() - Writes whatever remains in the fill-buffer, waits for every write, then closes the file
+//==========================================================================================================
+void CUringWriter::close()
+{
+    if (m_fallback) {m_fallback->close(); return;}
+
+    // The tail of the file is probably not a multiple of the O_DIRECT alignment.  Write as much of
+    // it as we can via the ring
+    size_t alignedLength = m_isDirect ? m_fillLength / DIRECT_ALIGN * DIRECT_ALIGN : m_fillLength;
+    if (alignedLength)
+    {
+        m_request[m_fillIndex] = {m_buffer[m_fillIndex], alignedLength, m_fileOffset, &m_iov[m_fillIndex]};
+        submit(m_fillIndex);
+    }
+
+    // Wait for everything in flight
+    drain();
+    if (m_ioError) throwErrno("Error writing", "output file", m_ioError);
+
+    // Turn off O_DIRECT and write whatever is left over
+    const uint8_t* tail   = m_buffer[m_fillIndex] + alignedLength;
+    size_t         length = m_fillLength - alignedLength;
+    uint64_t       offset = m_fileOffset + alignedLength;
+    if (length && m_isDirect) fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+    while (length)
+    {
+        ssize_t written = pwrite(m_fd, tail, length, offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) throwErrno("Error writing", "output file", written < 0 ? errno : EIO);
+        tail   += written;
+        length -= written;
+        offset += written;
+    }
+    m_fileOffset += m_fillLength;
+    m_fillLength  = 0;
+
+    // We're done with the ring
+    releaseRing();
+
+    // If less was written than was preallocated, don't leave the excess on the end
+    if (ftruncate(m_fd, m_fileOffset) != 0) throwErrno("Can't set the size of", "output file", errno);
+
+    // Close the output file and complain if that fails
+    int status = ::close(m_fd);
+    m_fd = -1;
+    if (status != 0) throwErrno("Error closing", "output file", errno);
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// submitFillBuffer() - Submits the fill-buffer, then switches to a buffer that isn't being written,
+//                      waiting for one to finish if they're all in flight
+//==========================================================================================================
+void CUringWriter::submitFillBuffer()
+{
+    m_request[m_fillIndex] = {m_buffer[m_fillIndex], m_fillLength, m_fileOffset, &m_iov[m_fillIndex]};
+    submit(m_fillIndex);
+
+    // The next buffer will be written just after this one
+    m_fileOffset += m_fillLength;
+
+    // Pick up whatever has finished, and wait if nothing is free
+    reap(false);
+    while (m_free.empty() && !m_ioError && reap(true));
+    if (m_ioError) throwErrno("Error writing", "output file", m_ioError);
+
+    // And start filling the free buffer
+    m_fillIndex  = m_free.back();
+    m_free.pop_back();
+    m_fillLength = 0;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// submit() - Queues the request for buffer 'index' and tells the kernel about it
+//==========================================================================================================
+void CUringWriter::submit(uint32_t index)
+{
+    request_t& r = m_request[index];
+
+    // Fill in the next submission queue entry
+    uint32_t tail = *m_sqTail;
+    uint32_t slot = tail & *m_sqMask;
+    io_uring_sqe& sqe = m_sqes[slot];
+    memset(&sqe, 0, sizeof sqe);
+
+    if (m_fixedBuffers)
+    {
+        sqe.opcode    = IORING_OP_WRITE_FIXED;
+        sqe.addr      = (uint64_t)r.data;
+        sqe.len       = r.length;
+        sqe.buf_index = index;
+    }
+    else
+    {
+        r.iov->iov_base = (void*)r.data;
+        r.iov->iov_len  = r.length;
+        sqe.opcode      = IORING_OP_WRITEV;
+        sqe.addr        = (uint64_t)r.iov;
+        sqe.len         = 1;
+    }
+
+    sqe.fd        = m_fixedFile ? 0 : m_fd;
+    sqe.flags     = m_fixedFile ? IOSQE_FIXED_FILE : 0;
+    sqe.off       = r.offset;
+    sqe.user_data = index;
+
+    // Publish it, then hand it to the kernel
+    m_sqArray[slot] = slot;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++m_inFlight;
+
+    while (uringEnter(m_ringFd, 1, 0, 0) < 0)
+    {
+        if (errno == EINTR) continue;
+        if ((errno == EAGAIN || errno == EBUSY) && reap(true)) continue;
+        throwErrno("Error submitting write to", "output file", errno);
+    }
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// reap() - Handles completed writes.  A short write is resubmitted for the part that's left, and a
+//          buffer whose write has finished goes back on the free list
+//
+// Returns: false if we were supposed to wait and couldn't
+//==========================================================================================================
+bool CUringWriter::reap(bool wait)
+{
+    uint32_t head = *m_cqHead;
+
+    // If we're supposed to wait and nothing has completed yet, wait for something to
+    if (wait && m_inFlight && head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+    {
+        if (uringEnter(m_ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            if (m_ioError == 0) m_ioError = errno;
+            return false;
+        }
+    }
+
+    // Handle every completion that has arrived
+    vector<uint32_t> resubmit;
+    while (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+    {
+        const io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+        uint32_t   index = cqe.user_data;
+        int        res   = cqe.res;
+        request_t& r     = m_request[index];
+        ++head;
+        --m_inFlight;
+
+        if (res == -EINTR || res == -EAGAIN)
+            resubmit.push_back(index);
+        else if (res < 0 || (res == 0 && r.length))
+        {
+            if (m_ioError == 0) m_ioError = (res < 0) ? -res : EIO;
+            m_free.push_back(index);
+        }
+        else if ((size_t)res < r.length)
+        {
+            r.data   += res;
+            r.length -= res;
+            r.offset += res;
+            resubmit.push_back(index);
+        }
+        else
+            m_free.push_back(index);
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+    // Whatever didn't finish goes back to the kernel
+    for (uint32_t index : resubmit) submit(index);
+    return true;
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// drain() - Waits for every write in flight to finish
+//==========================================================================================================
+void CUringWriter::drain()
+{
+    // If we can't even wait on the ring, there's nothing more we can do
+    while (m_inFlight && reap(true));
+}
+//==========================================================================================================
+
+
+//==========================================================================================================
+// releaseRing() - Unmaps the queues and closes the ring
+//==========================================================================================================
+void CUringWriter::releaseRing()
+{
+    if (m_sqes)   munmap(m_sqes, m_sqeSize);
+    if (m_cqRing) munmap(m_cqRing, m_cqRingSize);
+    if (m_sqRing) munmap(m_sqRing, m_sqRingSize);
+    if (m_ringFd >= 0) ::close(m_ringFd);
+    m_sqes   = nullptr;
+    m_sqRing = m_cqRing = nullptr;
+    m_ringFd = -1;
+}
+//==========================================================================================================
@@ -0,0 +1,112 @@
+//==========================================================================================================
+// uring_writer.h - Defines the back-end that writes the output file asynchronously via io_uring
+//==========================================================================================================
+#pragma once
+#include <stdint.h>
+#include <sys/uio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "frame_writer.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+
+//----------------------------------------------------------------------------------------------------------
+// CUringWriter - Gathers data into a pool of large aligned buffers and keeps many of them being written
+//                at once with io_uring, so that the device sees a deep queue rather than one write at a
+//                time.
+//
+// The output file is preallocated at its final size and opened with O_DIRECT (if the file-system
+// supports it).  The buffers and the file are registered with the kernel, so each write is a
+// WRITE_FIXED against a fixed file.  If the buffers can't be registered (RLIMIT_MEMLOCK, say), they're
+// written with ordinary WRITEV requests instead.  If the kernel doesn't support io_uring at all, this
+// falls back to the blocking CDirectWriter.
+//
+// The ring is driven with raw system calls, so there's no dependency on liburing
+//----------------------------------------------------------------------------------------------------------
+class CUringWriter : public CFrameWriter
+{
+public:
+
+    // 'bufferSize' is the size of each buffer (rounded up to a multiple of 4K), and 'queueDepth' is
+    // the number of buffers, and so the number of writes that can be in flight at once
+    CUringWriter(size_t bufferSize, uint32_t queueDepth);
+    ~CUringWriter();
+
+    void    open(std::string filename, uint64_t totalBytes);
+    void    write(const uint8_t* data, size_t length);
+    void    close();
+
+protected:
+
+    // A write that has been handed to the kernel and hasn't finished yet
+    struct request_t
+    {
+        const uint8_t*  data;
+        size_t          length;
+        uint64_t        offset;
+        iovec*          iov;
+    };
+
+    // Creates the ring and maps its queues.  Returns 0 or an errno
+    int     setupRing();
+
+    // Registers the buffers and the output file with the ring, if the kernel will let us
+    void    registerResources();
+
+    // Queues a write of buffer 'index' and tells the kernel about it
+    void    submit(uint32_t index);
+
+    // Writes the fill-buffer, then finds a free buffer to fill next
+    void    submitFillBuffer();
+
+    // Handles every completion that has arrived.  If 'wait' is true, first waits for at least one.
+    // Errors are recorded in m_ioError.  Returns false if the ring can't be waited on
+    bool    reap(bool wait);
+
+    // Waits for every write in flight to finish
+    void    drain();
+
+    // Unmaps the queues and closes the ring
+    void    releaseRing();
+
+    // If io_uring isn't available, everything is handed to this instead
+    std::unique_ptr<CDirectWriter> m_fallback;
+
+    // The size of each buffer, the buffers themselves, and the ones that aren't being written
+    size_t      m_bufferSize;
+    uint32_t    m_queueDepth;
+    std::vector<uint8_t*>  m_buffer;
+    std::vector<uint32_t>  m_free;
+    std::vector<request_t> m_request;
+    std::vector<iovec>     m_iov;
+
+    // Index of the buffer being filled, and how many bytes are in it
+    uint32_t    m_fillIndex;
+    size_t      m_fillLength;
+
+    // The output file, whether it was opened with O_DIRECT, and where the next buffer goes
+    int         m_fd;
+    bool        m_isDirect;
+    uint64_t    m_fileOffset;
+
+    // The ring, and the pieces of its submission and completion queues that we use
+    int         m_ringFd;
+    void*       m_sqRing;
+    void*       m_cqRing;
+    size_t      m_sqRingSize, m_cqRingSize, m_sqeSize;
+    io_uring_sqe* m_sqes;
+    io_uring_cqe* m_cqes;
+    uint32_t   *m_sqTail, *m_sqMask, *m_sqArray;
+    uint32_t   *m_cqHead, *m_cqTail, *m_cqMask;
+
+    // Whether the buffers and the output file are registered with the ring
+    bool        m_fixedBuffers, m_fixedFile;
+
+    // The number of writes in flight, and the errno of the first one that failed
+    uint32_t    m_inFlight;
+    int         m_ioError;
+};
+//----------------------------------------------------------------------------------------------------------